@@ -0,0 +1,105 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include "render.h"
+#include "batch.h"
+#include "profiler.h"
+
+static bool batch_reserve(SpriteBatch *batch, int capacity) {
+    if (capacity <= batch->capacity) return true;
+    SDL_Vertex *vertices = realloc(batch->vertices, capacity * 4 * sizeof(SDL_Vertex));
+    if (vertices == NULL) return false;
+    batch->vertices = vertices;
+    int *indices = realloc(batch->indices, capacity * 6 * sizeof(int));
+    if (indices == NULL) return false;
+    batch->indices = indices;
+    //two triangles per quad, the pattern never changes
+    for (int i = batch->capacity; i < capacity; i++) {
+        int *quad = &indices[i * 6];
+        quad[0] = i * 4;
+        quad[1] = i * 4 + 1;
+        quad[2] = i * 4 + 2;
+        quad[3] = i * 4 + 2;
+        quad[4] = i * 4 + 3;
+        quad[5] = i * 4;
+    }
+    batch->capacity = capacity;
+    return true;
+}
+
+bool batch_init(SpriteBatch *batch, Texture texture, int capacity) {
+    batch->texture = texture;
+    batch->vertices = NULL;
+    batch->indices = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+    return batch_reserve(batch, capacity);
+}
+
+void batch_destroy(SpriteBatch *batch) {
+    free(batch->vertices);
+    free(batch->indices);
+    batch->vertices = NULL;
+    batch->indices = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
+
+//room for one more quad, the batch is drawn if it can not grow
+static SDL_Vertex *batch_next(SpriteBatch *batch) {
+    if (batch->count == batch->capacity && !batch_reserve(batch, batch->capacity * 2)) {
+        batch_flush(batch);
+    }
+    return &batch->vertices[batch->count++ * 4];
+}
+
+//corners go clockwise from the top left
+static void set_uvs(SpriteBatch *batch, SDL_Vertex *quad, const SDL_Rect *src) {
+    float u0 = 0, v0 = 0, u1 = 1, v1 = 1;
+    if (src != NULL) {
+        u0 = (float) src->x / batch->texture.width;
+        v0 = (float) src->y / batch->texture.height;
+        u1 = (float) (src->x + src->w) / batch->texture.width;
+        v1 = (float) (src->y + src->h) / batch->texture.height;
+    }
+    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+    quad[0].tex_coord = (SDL_FPoint) {u0, v0};
+    quad[1].tex_coord = (SDL_FPoint) {u1, v0};
+    quad[2].tex_coord = (SDL_FPoint) {u1, v1};
+    quad[3].tex_coord = (SDL_FPoint) {u0, v1};
+    for (int i = 0; i < 4; i++) {
+        quad[i].color = white;
+    }
+}
+
+void batch_quad(SpriteBatch *batch, const SDL_Rect *src, SDL_FRect dst) {
+    SDL_Vertex *quad = batch_next(batch);
+    quad[0].position = (SDL_FPoint) {dst.x, dst.y};
+    quad[1].position = (SDL_FPoint) {dst.x + dst.w, dst.y};
+    quad[2].position = (SDL_FPoint) {dst.x + dst.w, dst.y + dst.h};
+    quad[3].position = (SDL_FPoint) {dst.x, dst.y + dst.h};
+    set_uvs(batch, quad, src);
+}
+
+void batch_rotated_quad(SpriteBatch *batch, const SDL_Rect *src, SDL_FRect dst, double angle) {
+    SDL_Vertex *quad = batch_next(batch);
+    float cx = dst.x + dst.w / 2, cy = dst.y + dst.h / 2;
+    float hw = dst.w / 2, hh = dst.h / 2;
+    //y points down, so this turns clockwise on the screen
+    float c = cos(angle * M_PI / 180.0), s = sin(angle * M_PI / 180.0);
+    const float corners[4][2] = {{-hw, -hh}, {hw, -hh}, {hw, hh}, {-hw, hh}};
+    for (int i = 0; i < 4; i++) {
+        quad[i].position.x = cx + corners[i][0] * c - corners[i][1] * s;
+        quad[i].position.y = cy + corners[i][0] * s + corners[i][1] * c;
+    }
+    set_uvs(batch, quad, src);
+}
+
+void batch_flush(SpriteBatch *batch) {
+    if (batch->count == 0) return;
+    SDL_RenderGeometry(g_renderer, batch->texture.texture_proper, batch->vertices, batch->count * 4,
+                       batch->indices, batch->count * 6);
+    PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+    batch->count = 0;
+}
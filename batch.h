@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H 1
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include "render.h"
+
+//Sprite batch - textured quads collected into one vertex buffer and drawn
+//with a single SDL_RenderGeometry call per flush (needs SDL 2.0.18).
+//Quads of one batch all come from its texture, flush before drawing anything
+//that has to go on top of them.
+
+typedef struct {
+    Texture texture;
+    SDL_Vertex *vertices;   //4 per quad
+    int *indices;           //6 per quad
+    int count;              //quads
+    int capacity;
+} SpriteBatch;
+
+bool batch_init(SpriteBatch *batch, Texture texture, int capacity);
+void batch_destroy(SpriteBatch *batch);
+//src of the texture drawn into dst
+void batch_quad(SpriteBatch *batch, const SDL_Rect *src, SDL_FRect dst);
+//like SDL_RenderCopyEx: dst rotated clockwise by angle degrees around its center
+void batch_rotated_quad(SpriteBatch *batch, const SDL_Rect *src, SDL_FRect dst, double angle);
+void batch_flush(SpriteBatch *batch);
+
+//set up by load_media
+extern SpriteBatch g_ant_batch;
+extern SpriteBatch g_leaf_batch;
+
+#endif
@@ -0,0 +1,464 @@
+/* Cants microbenchmarks.
+ * Times map loading, leaf respawning, the simulation tick (and how it scales with threads),
+ * npc culling and frame rendering
+ * on synthetic maps and prints the results as JSON (min/median/p99 over repeated runs)
+ * so that builds can be compared. Rendering uses the dummy video driver and a software renderer.
+ */
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "map.h"
+#include "rng.h"
+
+#if MAP_STREAMING
+#error "the benchmarks measure whole maps in memory, build them without MAP_STREAMING"
+#endif
+#include "npc.h"
+#include "pheromone.h"
+#include "food_distance.h"
+#include "sim.h"
+#include "render.h"
+#include "tile_layer.h"
+#include "workers.h"
+#include "cants_config.h"
+
+#define BENCH_MAP_PATH "cants-bench.map"
+#define BENCH_MAX_RUNS 1000
+#define BENCH_WARMUP_TICKS 200
+#define BENCH_FOOD_BATCH 64
+#define NPC_POOL_INIT_CAPACITY 64
+#define BENCH_SEED 1
+
+FILE *g_out;
+bool g_first_result = true;
+double g_samples[BENCH_MAX_RUNS];
+
+//respawn the leaves picked up since the last call like the main loop does
+void respawn_food(SDL_Rect view) {
+    for (int pickups = pickup_queue_drain(&g_pickup_queue, NULL, 0, NULL); pickups > 0; pickups--) {
+        create_food(view);
+    }
+}
+
+Uint64 now(void) {
+    return SDL_GetPerformanceCounter();
+}
+
+double elapsed_ns(Uint64 start) {
+    return (double) (SDL_GetPerformanceCounter() - start) * 1e9 / SDL_GetPerformanceFrequency();
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+//write the statistics of g_samples[0..runs) as one JSON object
+//items is the amount of work done per run (e.g. ants updated), 0 if it does not make sense
+void report(const char *name, const char *param, long value, int runs, double items) {
+    qsort(g_samples, runs, sizeof(double), compare_doubles);
+    double min = g_samples[0];
+    double median = g_samples[runs / 2];
+    double p99 = g_samples[(runs * 99 - 1) / 100];
+    fprintf(g_out, "%s\n    {\"name\": \"%s\", \"%s\": %ld, \"runs\": %d, "
+            "\"min_ns\": %.0f, \"median_ns\": %.0f, \"p99_ns\": %.0f",
+            g_first_result ? "" : ",", name, param, value, runs, min, median, p99);
+    if (items > 0) {
+        fprintf(g_out, ", \"items_per_s\": %.0f", items * 1e9 / median);
+    }
+    fprintf(g_out, "}");
+    g_first_result = false;
+    fprintf(stderr, "%-16s %s=%-7ld median %12.0f ns\n", name, param, value, median);
+}
+
+//write a square cants map: walls around the border and on every 10th tile on average,
+//an anthill in the middle, everything else free
+bool write_synthetic_map(const char *path, int size, enum MAP_ENCODING encoding) {
+    Map map = {0};
+    if (!alloc_map(&map, size, size)) return false;
+    Uint32 seed = 1;
+    for (int i = 0; i < size; i++) {
+        int8_t *row = MAP_ROW(map, i);
+        for (int j = 0; j < size; j++) {
+            seed = seed * 1103515245 + 12345;
+            if (i == 0 || j == 0 || i == size - 1 || j == size - 1 || (seed >> 16) % 10 == 0)
+                row[j] = MAP_WALL;
+            else
+                row[j] = MAP_FREE;
+            if (abs(i - size / 2) <= 1 && abs(j - size / 2) <= 1)
+                row[j] = MAP_ANTHILL;
+        }
+    }
+    SDL_RWops *file = SDL_RWFromFile(path, "wb");
+    bool ok = file != NULL &&
+        write_map_header(file, size, size, encoding) &&
+        write_map_tiles(file, &map, encoding);
+    destroy_map(&map);
+    return file != NULL && SDL_RWclose(file) == 0 && ok;
+}
+
+//load a fresh synthetic map of given size into g_map
+void setup_map(int size) {
+    destroy_map(&g_map);
+    food_distance_destroy(&g_food_distance);
+    sim_reset();
+    if (!write_synthetic_map(BENCH_MAP_PATH, size, MAP_ENCODING_RAW) || !load_map(BENCH_MAP_PATH) || !index_free_tiles()) {
+        fprintf(stderr, "Could not create a %dx%d map\n", size, size);
+        exit(1);
+    }
+    level_width = g_map.width * CELL_SIZE;
+    level_height = g_map.height * CELL_SIZE;
+}
+
+//load maps of an encoding, raw ones with the mapping loader (if MAP_MMAP) and by reading the file
+void bench_load_map(const char *name, bool (*load)(char *path), enum MAP_ENCODING encoding) {
+    const int sizes[] = {32, 64, 128, 255, 1024, 4096};
+    for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+        //the file is rewritten, it must not stay mapped
+        destroy_map(&g_map);
+        if (!write_synthetic_map(BENCH_MAP_PATH, sizes[s], encoding)) {
+            fprintf(stderr, "Could not write '%s'\n", BENCH_MAP_PATH);
+            exit(1);
+        }
+        //fewer runs of the big maps, one takes tens of milliseconds
+        int runs = sizes[s] >= 1024 ? 50 : 500;
+        for (int r = 0; r < runs; r++) {
+            destroy_map(&g_map);
+            Uint64 start = now();
+            bool loaded = load(BENCH_MAP_PATH);
+            g_samples[r] = elapsed_ns(start);
+            if (!loaded) {
+                fprintf(stderr, "Could not load '%s'\n", BENCH_MAP_PATH);
+                exit(1);
+            }
+        }
+        report(name, "size", sizes[s], runs, (double) sizes[s] * sizes[s]);
+    }
+}
+
+//spawn BENCH_FOOD_BATCH leaves outside of a screen sized view with a given percentage of free tiles left
+void bench_create_food(SDL_Rect view) {
+    const int free_percents[] = {75, 25, 5, 1};
+    for (size_t d = 0; d < sizeof free_percents / sizeof free_percents[0]; d++) {
+        setup_map(255);
+        Rng rng = rng_stream(BENCH_SEED, d);
+        int target = g_map.free_count * free_percents[d] / 100;
+        while (g_map.free_count > target) {
+            int32_t tile = g_map.free_tiles[rng_below(&rng, g_map.free_count)];
+            set_map_tile(tile % g_map.width, tile / g_map.width, MAP_FOOD);
+        }
+        if (!food_distance_init(&g_food_distance)) {
+            fprintf(stderr, "Could not allocate the food distances\n");
+            exit(1);
+        }
+
+        //every run starts from the same state
+        size_t tiles_size = g_map.stride * g_map.height;
+        size_t index_size = (size_t) g_map.width * g_map.height * sizeof(int32_t);
+        int8_t *tiles = malloc(tiles_size);
+        int32_t *free_tiles = malloc(index_size);
+        int32_t *free_slot = malloc(index_size);
+        int32_t *distances = malloc(index_size);
+        if (tiles == NULL || free_tiles == NULL || free_slot == NULL || distances == NULL) {
+            fprintf(stderr, "Could not allocate memory\n");
+            exit(1);
+        }
+        memcpy(tiles, g_map.tiles, tiles_size);
+        memcpy(free_tiles, g_map.free_tiles, index_size);
+        memcpy(free_slot, g_map.free_slot, index_size);
+        if (g_food_distance.distances != NULL) memcpy(distances, g_food_distance.distances, index_size);
+        int free_count = g_map.free_count;
+
+        int runs = 200;
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            for (int i = 0; i < BENCH_FOOD_BATCH; i++) {
+                create_food(view);
+            }
+            g_samples[r] = elapsed_ns(start);
+            memcpy(g_map.tiles, tiles, tiles_size);
+            memcpy(g_map.free_tiles, free_tiles, index_size);
+            memcpy(g_map.free_slot, free_slot, index_size);
+            if (g_food_distance.distances != NULL) memcpy(g_food_distance.distances, distances, index_size);
+            g_map.free_count = free_count;
+        }
+        report("create_food", "free_percent", free_percents[d], runs, BENCH_FOOD_BATCH);
+        free(tiles);
+        free(free_tiles);
+        free(free_slot);
+        free(distances);
+    }
+}
+
+//set up a 255x255 map with a number of npcs that have left the anthill
+void setup_colony(Player *player, Anthill *anthill, int ants) {
+    setup_map(255);
+    npc_pool_clear(&g_npcs);
+    if (!npc_grid_init(&g_npcs, g_map.width, g_map.height) ||
+        !pheromone_init(&g_pheromones, g_map.width, g_map.height) || !food_distance_init(&g_food_distance)) {
+        fprintf(stderr, "Could not allocate the npc grid\n");
+        exit(1);
+    }
+    init_anthill(anthill);
+    free(player->ant);
+    memset(player, 0, sizeof *player);
+    if ((player->ant = create_ant((anthill->gm_x + 0.5) * CELL_SIZE, anthill->gm_y * CELL_SIZE)) == NULL) {
+        fprintf(stderr, "Could not allocate memory for player ant\n");
+        exit(1);
+    }
+    SDL_Rect no_view = {0};
+    seed_food(no_view);
+    for (int i = 0; i < ants; i++) {
+        if (create_npc(anthill->gm_x, anthill->gm_y) == NPC_NONE) {
+            fprintf(stderr, "Could not create npc #%d\n", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < BENCH_WARMUP_TICKS; i++) {
+        sim_tick(player, anthill);
+        respawn_food(no_view);
+    }
+}
+
+void bench_sim_tick(Player *player, Anthill *anthill) {
+    const int ant_counts[] = {1000, 10000, 100000};
+    SDL_Rect no_view = {0};
+    for (size_t a = 0; a < sizeof ant_counts / sizeof ant_counts[0]; a++) {
+        setup_colony(player, anthill, ant_counts[a]);
+        int runs = ant_counts[a] >= 100000 ? 100 : 500;
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            sim_tick(player, anthill);
+            g_samples[r] = elapsed_ns(start);
+            //leaves are respawned by the main loop, not the tick
+            respawn_food(no_view);
+        }
+        report("sim_tick", "ants", ant_counts[a], runs, ant_counts[a]);
+    }
+}
+
+//sim_tick of a big colony on 1, 2, 4... threads up to one per CPU core
+void bench_sim_threads(Player *player, Anthill *anthill) {
+    const int ants = 100000, runs = 100;
+    int max_threads = SDL_GetCPUCount();
+    SDL_Rect no_view = {0};
+    for (int threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        if (!workers_init(threads)) {
+            fprintf(stderr, "Could not start %d worker threads\n", threads);
+            break;
+        }
+        setup_colony(player, anthill, ants);
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            sim_tick(player, anthill);
+            g_samples[r] = elapsed_ns(start);
+            respawn_food(no_view);
+        }
+        report("sim_tick_threads", "threads", workers_count(), runs, ants);
+        if (threads >= max_threads) break;
+    }
+    workers_init(0);
+}
+
+//one evaporation and diffusion step of the whole pheromone field on one thread
+void bench_pheromones(void) {
+    const int sizes[] = {256, 1024, 2048};
+    for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+        PheromoneField field = {0};
+        if (!pheromone_init(&field, sizes[s], sizes[s])) {
+            fprintf(stderr, "Could not allocate a %dx%d pheromone field\n", sizes[s], sizes[s]);
+            exit(1);
+        }
+        //not used in this build (FOOD_DISTANCE)
+        if (field.levels == NULL) return;
+        Rng rng = rng_stream(BENCH_SEED, s);
+        for (int i = 0; i < sizes[s] * sizes[s] / 100; i++) {
+            pheromone_deposit(&field, rng_below(&rng, sizes[s]), rng_below(&rng, sizes[s]), PHEROMONE_DEPOSIT);
+        }
+        int runs = sizes[s] >= 2048 ? 50 : 200;
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            pheromone_update_rows(&field, 0, field.height);
+            pheromone_swap(&field);
+            g_samples[r] = elapsed_ns(start);
+        }
+        report("pheromone_update", "size", sizes[s], runs, (double) sizes[s] * sizes[s]);
+        pheromone_destroy(&field);
+    }
+}
+
+//a leaf picked up and another one spawned with the food distances kept up to date
+void bench_food_distance(void) {
+    const int sizes[] = {255, 1023, 2047};
+    SDL_Rect no_view = {0};
+    for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+        setup_map(sizes[s]);
+        seed_food(no_view);
+        if (!food_distance_init(&g_food_distance)) {
+            fprintf(stderr, "Could not allocate the food distances\n");
+            exit(1);
+        }
+        Rng rng = rng_stream(BENCH_SEED, s);
+        int runs = 500;
+        for (int r = 0; r < runs; r++) {
+            int x, y;
+            do {
+                x = rng_below(&rng, g_map.width);
+                y = rng_below(&rng, g_map.height);
+            } while (MAP_TILE(x, y) != MAP_FOOD);
+            Uint64 start = now();
+            remove_food(x, y, NPC_NONE);
+            respawn_food(no_view);
+            g_samples[r] = elapsed_ns(start);
+        }
+        report("food_distance", "size", sizes[s], runs, 0);
+        if (!food_distance_check(&g_food_distance)) {
+            fprintf(stderr, "The food distances differ from those built from scratch after %d updates\n", runs);
+            exit(1);
+        }
+    }
+}
+
+//the npc visibility test of render_game_objects
+void bench_culling(Player *player, Anthill *anthill) {
+    const int ant_counts[] = {1000, 10000, 100000};
+    for (size_t a = 0; a < sizeof ant_counts / sizeof ant_counts[0]; a++) {
+        setup_colony(player, anthill, ant_counts[a]);
+        set_camera(player);
+        int runs = 500;
+        size_t visible = 0;
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            for (size_t i = 0; i < g_npcs.count; i++) {
+                SDL_Rect coords = {
+                    g_npcs.x[i],
+                    g_npcs.y[i],
+                    g_ant_texture.width / ANT_FRAMES_NUM,
+                    g_ant_texture.height
+                };
+                visible += check_collision(coords, g_camera);
+            }
+            g_samples[r] = elapsed_ns(start);
+        }
+        report("culling", "ants", ant_counts[a], runs, ant_counts[a]);
+
+        //the same through the grid, as render_game_objects does it
+        size_t grid_visible = 0;
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            NpcGridRange range = npc_grid_range(&g_npcs,
+                g_camera.x / CELL_SIZE - 2, g_camera.y / CELL_SIZE - 2,
+                (g_camera.x + g_camera.w) / CELL_SIZE + 2, (g_camera.y + g_camera.h) / CELL_SIZE + 2);
+            for (int by = range.by0; by < range.by1; by++) {
+                for (int bx = range.bx0; bx < range.bx1; bx++) {
+                    for (uint32_t slot = NPC_GRID_HEAD(&g_npcs, bx, by); slot != NPC_GRID_END; slot = g_npcs.grid_next[slot]) {
+                        size_t i = g_npcs.dense_of[slot];
+                        SDL_Rect coords = {
+                            g_npcs.x[i],
+                            g_npcs.y[i],
+                            g_ant_texture.width / ANT_FRAMES_NUM,
+                            g_ant_texture.height
+                        };
+                        grid_visible += check_collision(coords, g_camera);
+                    }
+                }
+            }
+            g_samples[r] = elapsed_ns(start);
+        }
+        report("culling_grid", "ants", ant_counts[a], runs, ant_counts[a]);
+        //keep the loops from being optimized away
+        if (visible == 0) fprintf(stderr, "no npcs on the screen\n");
+        if (grid_visible != visible) fprintf(stderr, "the grid sees %zu npcs instead of %zu\n", grid_visible, visible);
+    }
+}
+
+void bench_render(Player *player, Anthill *anthill) {
+    const int ant_counts[] = {100, 1000, 10000};
+    for (size_t a = 0; a < sizeof ant_counts / sizeof ant_counts[0]; a++) {
+        setup_colony(player, anthill, ant_counts[a]);
+        set_camera(player);
+        if (!tile_layer_init()) {
+            fprintf(stderr, "Could not initialize the tile layer\n");
+            exit(1);
+        }
+        int runs = 100;
+        for (int r = 0; r < runs; r++) {
+            Uint64 start = now();
+            render_game_objects(player, anthill);
+            SDL_RenderPresent(g_renderer);
+            g_samples[r] = elapsed_ns(start);
+        }
+        report("render", "ants", ant_counts[a], runs, 0);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        printf("Usage: cants-bench [output.json]\n"
+               "Runs the cants microbenchmarks and writes the results as JSON to [output.json] or stdout\n");
+        exit(0);
+    }
+    g_out = stdout;
+    if (argc == 2 && (g_out = fopen(argv[1], "w")) == NULL) {
+        fprintf(stderr, "Could not open '%s'\n", argv[1]);
+        exit(1);
+    }
+
+    //no window is ever shown, the frames are drawn onto a surface
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+    scc(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER), "Could not initialize SDL");
+    ttfcc(TTF_Init(), "Could not initialize SDL_ttf");
+    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+        SDL_Log("SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError());
+        exit(1);
+    }
+    SDL_Surface *screen;
+    scp((screen = SDL_CreateRGBSurfaceWithFormat(0, screen_width, screen_height, 32, SDL_PIXELFORMAT_ARGB8888)),
+            "Could not create screen surface");
+    scp((g_renderer = SDL_CreateSoftwareRenderer(screen)), "Could not create renderer");
+    g_camera.w = screen_width;
+    g_camera.h = screen_height;
+    load_media();
+    if (!npc_pool_init(&g_npcs, NPC_POOL_INIT_CAPACITY)) {
+        fprintf(stderr, "Could not initialize npc pool\n");
+        exit(1);
+    }
+    if (!workers_init(0)) {
+        fprintf(stderr, "Could not start worker threads, the simulation runs on one\n");
+    }
+    sim_seed(BENCH_SEED);
+
+    Player player = {0};
+    Anthill anthill = {0};
+    //a screen sized view in the middle of the map
+    SDL_Rect view = {255 * CELL_SIZE / 2 - screen_width / 2, 255 * CELL_SIZE / 2 - screen_height / 2,
+        screen_width, screen_height};
+
+    fprintf(g_out, "{\"benchmarks\": [");
+    bench_load_map("load_map", load_map, MAP_ENCODING_RAW);
+    bench_load_map("load_map_copy", load_map_copy, MAP_ENCODING_RAW);
+    bench_load_map("load_map_packed", load_map, MAP_ENCODING_PACKED);
+    bench_load_map("load_map_rle", load_map, MAP_ENCODING_RLE);
+    bench_create_food(view);
+    bench_sim_tick(&player, &anthill);
+    bench_sim_threads(&player, &anthill);
+    bench_pheromones();
+    bench_food_distance();
+    bench_culling(&player, &anthill);
+    bench_render(&player, &anthill);
+    fprintf(g_out, "\n]}\n");
+
+    free(player.ant);
+    npc_pool_destroy(&g_npcs);
+    destroy_map(&g_map);
+    remove(BENCH_MAP_PATH);
+    closesdl();
+    SDL_FreeSurface(screen);
+    if (g_out != stdout) fclose(g_out);
+    return 0;
+}
@@ -14,4 +14,30 @@
 #define TUTORIAL 1
 #endif
 
+/* load maps with mmap (not on Windows, Android falls back to reading files inside the apk) */
+#ifndef MAP_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define MAP_MMAP 1
+#else
+#define MAP_MMAP 0
+#endif
+#endif
+
+/* keep only the pages of the map around the camera and the ants in memory, for worlds that do not fit */
+#ifndef MAP_STREAMING
+#define MAP_STREAMING 0
+#endif
+
+/* npcs head for the nearest leaf along a distance field kept up to date as leaves come and go
+   (not with MAP_STREAMING), at 0 they look for leaves by following pheromones and wandering
+   and only then is the pheromone field kept */
+#ifndef FOOD_DISTANCE
+#define FOOD_DISTANCE 1
+#endif
+
+/* frame phase timings (F3 overlay, F4 csv trace), compiled out unless debugging */
+#ifndef PROFILER
+#define PROFILER DEBUGMODE
+#endif
+
 #endif
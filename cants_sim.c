@@ -0,0 +1,235 @@
+/* Headless cants simulation for load testing.
+ * Loads a map, seeds leaves and npcs and runs the simulation (npcs, leaves and anthill upgrades)
+ * for a number of ticks as fast as possible without creating a window or a renderer.
+ * With --replay it runs a game recorded by `cants --record` instead and writes the state hash
+ * of every tick, so that two builds can be checked to behave the same.
+ */
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <string.h>
+#include "map.h"
+#include "npc.h"
+#include "pheromone.h"
+#include "food_distance.h"
+#include "sim.h"
+#include "workers.h"
+#include "replay.h"
+
+#define DEFAULT_TICKS 10000
+#define DEFAULT_ANTS 1000
+#define DEFAULT_SEED 1
+#define NPC_POOL_INIT_CAPACITY 64
+
+void usage(void) {
+    printf("Usage: cants-sim [--seed n] <map> [ticks] [ants] [threads]\n"
+           "       cants-sim --replay <replay> [hashes]\n"
+           "Runs the simulation of <map> for [ticks] (default %d) ticks with [ants] (default %d) npcs\n"
+           "on [threads] (default one per CPU core) threads. Runs with the same seed (default %d) are the same\n"
+           "or runs a game recorded with `cants --record <replay>` writing a state hash per tick to [hashes]\n",
+           DEFAULT_TICKS, DEFAULT_ANTS, DEFAULT_SEED);
+    exit(0);
+}
+
+bool isnumber(char *str) {
+    while (*str) {
+        if (!isdigit(*str++)) return false;
+    }
+    return true;
+}
+
+//run a recorded game as fast as possible, what the main loop of the game did comes from the replay
+int run_replay(char *replay_path, char *hashes_path) {
+    Replay replay;
+    if (!replay_open(&replay, replay_path)) exit(1);
+    FILE *hashes = NULL;
+    if (hashes_path != NULL && (hashes = fopen(hashes_path, "w")) == NULL) {
+        fprintf(stderr, "Could not open '%s'\n", hashes_path);
+        exit(1);
+    }
+
+    //the same setup as the game
+    sim_seed(replay.seed);
+    if (!load_map(replay.map_path) || !index_free_tiles()) {
+        fprintf(stderr, "Could not load map '%s'\n", replay.map_path);
+        exit(1);
+    }
+    if (!npc_pool_init(&g_npcs, NPC_POOL_INIT_CAPACITY) || !npc_grid_init(&g_npcs, g_map.width, g_map.height) ||
+        !pheromone_init(&g_pheromones, g_map.width, g_map.height) || !food_distance_init(&g_food_distance)) {
+        fprintf(stderr, "Could not initialize npc pool\n");
+        exit(1);
+    }
+    if (!workers_init(0)) {
+        fprintf(stderr, "Could not start worker threads, running on one\n");
+    }
+    Anthill anthill = {0};
+    init_anthill(&anthill);
+    Player player = {0};
+    if ((player.ant = create_ant((anthill.gm_x + 0.5) * CELL_SIZE, anthill.gm_y * CELL_SIZE)) == NULL) {
+        fprintf(stderr, "Could not allocate memory for player ant\n");
+        exit(1);
+    }
+    seed_food(replay.view);
+
+    printf("replay '%s': map '%s' %dx%d, seed %llu, %d threads\n", replay_path, replay.map_path,
+           g_map.width, g_map.height, (unsigned long long) replay.seed, workers_count());
+
+    long desyncs = 0;
+    bool ended = false;
+    uint64_t hash = sim_state_hash(&player, &anthill);
+    ReplayEvent event;
+    Uint64 start = SDL_GetPerformanceCounter();
+    while (!ended && replay_read(&replay, &event)) {
+        while (g_sim_ticks < event.tick) {
+            sim_tick(&player, &anthill);
+            hash = sim_state_hash(&player, &anthill);
+            if (hashes != NULL) fprintf(hashes, "%llu %016llx\n", (unsigned long long) g_sim_ticks, (unsigned long long) hash);
+        }
+        switch (event.type) {
+            case REPLAY_STEER:
+                player.vel = event.vel;
+                player.turn_vel = event.turn_vel;
+                break;
+            case REPLAY_UPGRADE:
+                if (!upgrade_anthill(&player, &anthill)) desyncs++;
+                break;
+            case REPLAY_QUEUE_NPC:
+                queue_npcs(1);
+                break;
+            case REPLAY_ADD_FOOD:
+                player.food_count++;
+                break;
+            case REPLAY_PICKUPS:;
+                int pickups = pickup_queue_drain(&g_pickup_queue, NULL, 0, NULL);
+                if (pickups == 0) desyncs++;
+                player.food_count += pickups;
+                for (int i = 0; i < pickups; i++) {
+                    create_food(event.view);
+                }
+                break;
+            case REPLAY_END:
+                ended = true;
+                break;
+        }
+    }
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    if (!ended) fprintf(stderr, "The replay is truncated or corrupt, stopped at tick %llu\n",
+                        (unsigned long long) g_sim_ticks);
+
+    printf("time: %.3f s\n", seconds);
+    printf("ticks: %llu, ticks/s: %.0f\n", (unsigned long long) g_sim_ticks, g_sim_ticks / seconds);
+    printf("final hash: %016llx\n", (unsigned long long) hash);
+    printf("anthill level: %d/%d, ants: %zu\n", anthill.level, MAX_LEVEL, g_npcs.count);
+    if (desyncs > 0) printf("the simulation did not follow the recording %ld times\n", desyncs);
+    bool distances_ok = food_distance_check(&g_food_distance);
+    if (!distances_ok) printf("the food distances differ from those built from scratch\n");
+
+    replay_close(&replay);
+    if (hashes != NULL) fclose(hashes);
+    free(player.ant);
+    workers_destroy();
+    npc_pool_destroy(&g_npcs);
+    pheromone_destroy(&g_pheromones);
+    food_distance_destroy(&g_food_distance);
+    destroy_map(&g_map);
+    return ended && desyncs == 0 && distances_ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+        if (argc < 3 || argc > 4) usage();
+        return run_replay(argv[2], argc > 3 ? argv[3] : NULL);
+    }
+    //--seed may come anywhere, the rest are positional
+    unsigned long long seed = DEFAULT_SEED;
+    int args = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0) {
+            if (i + 1 == argc || !isnumber(argv[i + 1])) usage();
+            seed = strtoull(argv[++i], NULL, 10);
+        }
+        else
+            argv[args++] = argv[i];
+    }
+    argc = args;
+    if (argc < 2 || argc > 5 || (argc > 2 && !isnumber(argv[2])) || (argc > 3 && !isnumber(argv[3])) ||
+            (argc > 4 && !isnumber(argv[4])))
+        usage();
+    char *map_path = argv[1];
+    long ticks = argc > 2 ? atol(argv[2]) : DEFAULT_TICKS;
+    int ants = argc > 3 ? atoi(argv[3]) : DEFAULT_ANTS;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    sim_seed(seed);
+
+    if (!load_map(map_path) || !index_free_tiles()) {
+        fprintf(stderr, "Could not load map '%s'\n", map_path);
+        exit(1);
+    }
+    if (!npc_pool_init(&g_npcs, NPC_POOL_INIT_CAPACITY) || !pheromone_init(&g_pheromones, g_map.width, g_map.height) ||
+        !food_distance_init(&g_food_distance)) {
+        fprintf(stderr, "Could not initialize npc pool\n");
+        exit(1);
+    }
+
+    Anthill anthill = {0};
+    init_anthill(&anthill);
+    Player player = {0};
+    if ((player.ant = create_ant((anthill.gm_x + 0.5) * CELL_SIZE, anthill.gm_y * CELL_SIZE)) == NULL) {
+        fprintf(stderr, "Could not allocate memory for player ant\n");
+        exit(1);
+    }
+
+    //nothing is on the screen, leaves may spawn anywhere
+    SDL_Rect no_view = {0};
+    seed_food(no_view);
+    for (int i = 0; i < ants; i++) {
+        if (create_npc(anthill.gm_x, anthill.gm_y) == NPC_NONE) {
+            fprintf(stderr, "Could not create npc #%d\n", i);
+            exit(1);
+        }
+    }
+    if (!workers_init(threads)) {
+        fprintf(stderr, "Could not start worker threads, running on one\n");
+    }
+
+    printf("map '%s' %dx%d, %d ants, %ld ticks, %d threads, seed %llu\n", map_path, g_map.width, g_map.height,
+           ants, ticks, workers_count(), seed);
+
+    long total_pickups = 0;
+    double ants_updated = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (long tick = 0; tick < ticks; tick++) {
+        ants_updated += g_npcs.count;
+        sim_tick(&player, &anthill);
+
+        //what the main loop does once per frame, the colony upgrades as soon as it can
+        int pickups = pickup_queue_drain(&g_pickup_queue, NULL, 0, NULL);
+        total_pickups += pickups;
+        player.food_count += pickups;
+        for (int i = 0; i < pickups; i++) {
+            create_food(no_view);
+        }
+        upgrade_anthill(&player, &anthill);
+    }
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    printf("time: %.3f s\n", seconds);
+    printf("ticks/s: %.0f\n", ticks / seconds);
+    printf("ants updated/s: %.0f\n", ants_updated / seconds);
+    printf("leaves picked up: %ld\n", total_pickups);
+    printf("anthill level: %d/%d, ants: %zu\n", anthill.level, MAX_LEVEL, g_npcs.count);
+    //the distances the ants followed were kept up to date leaf by leaf, they have to match a fresh search
+    bool distances_ok = food_distance_check(&g_food_distance);
+    if (!distances_ok) printf("the food distances differ from those built from scratch\n");
+
+    free(player.ant);
+    workers_destroy();
+    npc_pool_destroy(&g_npcs);
+    pheromone_destroy(&g_pheromones);
+    food_distance_destroy(&g_food_distance);
+    destroy_map(&g_map);
+    return distances_ok ? 0 : 1;
+}
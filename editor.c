@@ -1,8 +1,12 @@
 /* Cants map editor.
  * A cants map is a binary format that consists of:
- * a byte for height (uint8)
- * a byte for width (uint8)
- * binary data of the map (width * height bytes, because a single tile is an int8_t)
+ * the signature (CANTS_MAP_SIGNATURE without the terminating zero)
+ * a zero byte, then a byte each for the version (2), the tile encoding and a reserved one
+ * width and height (uint32, little endian)
+ * binary data of the map (width * height bytes for the raw encoding, because a single tile is an int8_t,
+ * packed and run length encodings are described in map.h)
+ * Version 1 maps have a byte for width and a byte for height right after the signature,
+ * they are loaded as well and saved as version 2 (see map.h).
  */
 
 #include <SDL2/SDL.h>
@@ -10,6 +14,10 @@
 #include <SDL2/SDL_ttf.h>
 #include <stdio.h>
 #include "map.h"
+
+#if MAP_STREAMING
+#error "the editor works on whole maps, build it without MAP_STREAMING"
+#endif
 #include <errno.h>
 #include <ctype.h>
 #include <string.h>
@@ -143,10 +151,36 @@ char *tile_to_string(enum MAP tile) {
     }
 }
 
+char *encoding_to_string(enum MAP_ENCODING encoding) {
+
+    switch (encoding) {
+        case MAP_ENCODING_RAW:
+            return "raw";
+        case MAP_ENCODING_PACKED:
+            return "packed";
+        case MAP_ENCODING_RLE:
+            return "rle";
+        default:
+            return "unknown";
+    }
+}
+
+//MAP_ENCODINGS_NUM if there is no such encoding
+enum MAP_ENCODING string_to_encoding(char *str) {
+    for (int i = 0; i < MAP_ENCODINGS_NUM; i++) {
+        if (strcmp(str, encoding_to_string(i)) == 0) return i;
+    }
+    return MAP_ENCODINGS_NUM;
+}
+
 int min(int a, int b) {
     return (a < b) ? a: b;
 }
 
+int max(int a, int b) {
+    return (a > b) ? a: b;
+}
+
 void setmode(int mode) {
     if (mode == cur_mode) return;
     cur_mode = mode;
@@ -199,11 +233,8 @@ bool write_map_to_file(char *path) {
     }
 
 
-    char signature[] = CANTS_MAP_SIGNATURE;
-    SDL_RWwrite(map_file, &signature, sizeof(char), sizeof(signature) - 1 * sizeof(char));
-    
-    SDL_RWwrite(map_file, &g_map.width,  sizeof g_map.width, 1);
-    SDL_RWwrite(map_file, &g_map.height, sizeof g_map.height, 1);
+    //maps keep the encoding they were loaded with (see convert)
+    bool written = write_map_header(map_file, g_map.width, g_map.height, g_map.encoding);
 
     int8_t buf[9];
     int gm_x = 0, gm_y = 0;
@@ -211,90 +242,100 @@ bool write_map_to_file(char *path) {
     if (g_anthill.x != -1) {
         gm_x = g_anthill.x / CELL_SIZE;
         gm_y = g_anthill.y / CELL_SIZE;
-        buf[0] = g_map.matrix[gm_y + 0][gm_x + 0];
-        buf[1] = g_map.matrix[gm_y + 1][gm_x + 0];
-        buf[2] = g_map.matrix[gm_y + 2][gm_x + 0];
-        buf[3] = g_map.matrix[gm_y + 0][gm_x + 1];
-        buf[4] = g_map.matrix[gm_y + 1][gm_x + 1];
-        buf[5] = g_map.matrix[gm_y + 2][gm_x + 1];
-        buf[6] = g_map.matrix[gm_y + 0][gm_x + 2];
-        buf[7] = g_map.matrix[gm_y + 1][gm_x + 2];
-        buf[8] = g_map.matrix[gm_y + 2][gm_x + 2];
-        g_map.matrix[gm_y + 0][gm_x + 0] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 1][gm_x + 0] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 2][gm_x + 0] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 0][gm_x + 1] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 1][gm_x + 1] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 2][gm_x + 1] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 0][gm_x + 2] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 1][gm_x + 2] = MAP_ANTHILL;
-        g_map.matrix[gm_y + 2][gm_x + 2] = MAP_ANTHILL;
+        buf[0] = MAP_TILE(gm_x + 0, gm_y + 0);
+        buf[1] = MAP_TILE(gm_x + 0, gm_y + 1);
+        buf[2] = MAP_TILE(gm_x + 0, gm_y + 2);
+        buf[3] = MAP_TILE(gm_x + 1, gm_y + 0);
+        buf[4] = MAP_TILE(gm_x + 1, gm_y + 1);
+        buf[5] = MAP_TILE(gm_x + 1, gm_y + 2);
+        buf[6] = MAP_TILE(gm_x + 2, gm_y + 0);
+        buf[7] = MAP_TILE(gm_x + 2, gm_y + 1);
+        buf[8] = MAP_TILE(gm_x + 2, gm_y + 2);
+        MAP_TILE(gm_x + 0, gm_y + 0) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 0, gm_y + 1) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 0, gm_y + 2) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 1, gm_y + 0) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 1, gm_y + 1) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 1, gm_y + 2) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 2, gm_y + 0) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 2, gm_y + 1) = MAP_ANTHILL;
+        MAP_TILE(gm_x + 2, gm_y + 2) = MAP_ANTHILL;
     }
 
-    for (int i = 0; i < g_map.height; i++) {
-        SDL_RWwrite(map_file, g_map.matrix[i], sizeof(int8_t), g_map.width);
-    }
+    written = written && write_map_tiles(map_file, &g_map, g_map.encoding);
     SDL_RWclose(map_file);
 
     if (g_anthill.x != -1) {
-        g_map.matrix[gm_y + 0][gm_x + 0] = buf[0];
-        g_map.matrix[gm_y + 1][gm_x + 0] = buf[1];
-        g_map.matrix[gm_y + 2][gm_x + 0] = buf[2];
-        g_map.matrix[gm_y + 0][gm_x + 1] = buf[3];
-        g_map.matrix[gm_y + 1][gm_x + 1] = buf[4];
-        g_map.matrix[gm_y + 2][gm_x + 1] = buf[5];
-        g_map.matrix[gm_y + 0][gm_x + 2] = buf[6];
-        g_map.matrix[gm_y + 1][gm_x + 2] = buf[7];
-        g_map.matrix[gm_y + 2][gm_x + 2] = buf[8];
+        MAP_TILE(gm_x + 0, gm_y + 0) = buf[0];
+        MAP_TILE(gm_x + 0, gm_y + 1) = buf[1];
+        MAP_TILE(gm_x + 0, gm_y + 2) = buf[2];
+        MAP_TILE(gm_x + 1, gm_y + 0) = buf[3];
+        MAP_TILE(gm_x + 1, gm_y + 1) = buf[4];
+        MAP_TILE(gm_x + 1, gm_y + 2) = buf[5];
+        MAP_TILE(gm_x + 2, gm_y + 0) = buf[6];
+        MAP_TILE(gm_x + 2, gm_y + 1) = buf[7];
+        MAP_TILE(gm_x + 2, gm_y + 2) = buf[8];
     }
-    return true;
+    return written;
 }
 
 void usage(void) {
-    printf("Usage: editor <file> | create <filename> <width> <height> | info <file> | translate <file> <x> <y> | resize <file> <dx> <dy>\nSee README for details\n");
+    printf("Usage: editor <file> | create <filename> <width> <height> | info <file> | translate <file> <x> <y> | resize <file> <dx> <dy> | convert <file> <raw|packed|rle>\nSee README for details\n");
     exit(0);
 }
 
-void translate(int x, int y) {
+bool translate(int x, int y) {
+    x %= g_map.width;
+    y %= g_map.height;
+    //rows (and tiles in a row) are rotated through a buffer of the part that wraps around,
+    //it is on the heap because big maps would overflow the stack
+    size_t buf_size = (size_t) abs(y) * g_map.stride + abs(x);
+    int8_t *buf = malloc(buf_size);
+    if (buf == NULL && buf_size > 0) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
     if (g_anthill.x != -1) {
         g_anthill.x += x * CELL_SIZE;
         g_anthill.y -= y * CELL_SIZE;
     }
+    //rows are contiguous, so rotating them is rotating whole strides of the buffer
     if (y > 0) {
-        int8_t *buf[y];
-        memcpy(buf, g_map.matrix, y * sizeof(int8_t *));
-        memmove(g_map.matrix, g_map.matrix + y, (g_map.height - y) * sizeof(int8_t *));
-        memcpy(g_map.matrix + g_map.height - y, buf, y * sizeof(int8_t *));
+        memcpy(buf, g_map.tiles, y * g_map.stride);
+        memmove(g_map.tiles, MAP_ROW(g_map, y), (g_map.height - y) * g_map.stride);
+        memcpy(MAP_ROW(g_map, g_map.height - y), buf, y * g_map.stride);
     }
     else if (y < 0) {
         y = -y;
-        int8_t *buf[y];
-        memcpy(buf, g_map.matrix + g_map.height - y, y * sizeof(int8_t *));
-        memmove(g_map.matrix + y, g_map.matrix, (g_map.height - y) * sizeof(int8_t *));
-        memcpy(g_map.matrix, buf, y * sizeof(int8_t *));
+        memcpy(buf, MAP_ROW(g_map, g_map.height - y), y * g_map.stride);
+        memmove(MAP_ROW(g_map, y), g_map.tiles, (g_map.height - y) * g_map.stride);
+        memcpy(g_map.tiles, buf, y * g_map.stride);
     }
     if (x > 0)
         for (int i = 0; i < g_map.height; i++) {
-            int8_t buf[x];
-            memcpy(buf, g_map.matrix[i] + g_map.width - x, x * sizeof(int8_t));
-            memmove(g_map.matrix[i] + x, g_map.matrix[i], (g_map.width - x) * sizeof(int8_t));
-            memcpy(g_map.matrix[i], buf, x * sizeof(int8_t));
+            int8_t *row = MAP_ROW(g_map, i);
+            memcpy(buf, row + g_map.width - x, x * sizeof(int8_t));
+            memmove(row + x, row, (g_map.width - x) * sizeof(int8_t));
+            memcpy(row, buf, x * sizeof(int8_t));
         }
     else if (x < 0) {
         x = -x;
         for (int i = 0; i < g_map.height; i++) {
-            int8_t buf[x];
-            memcpy(buf, g_map.matrix[i], x * sizeof(int8_t));
-            memmove(g_map.matrix[i], g_map.matrix[i] + x, (g_map.width - x) * sizeof(int8_t));
-            memcpy(g_map.matrix[i] + g_map.width - x, buf, x * sizeof(int8_t));
+            int8_t *row = MAP_ROW(g_map, i);
+            memcpy(buf, row, x * sizeof(int8_t));
+            memmove(row, row + x, (g_map.width - x) * sizeof(int8_t));
+            memcpy(row + g_map.width - x, buf, x * sizeof(int8_t));
         }
     }
+    free(buf);
+    return true;
 }
 
 
 void edit(char *map_path) {
     printf("Loading map...\n");
-    if (!load_map(map_path)) {
+    //the map is saved over its file, so it can not stay mapped
+    if (!load_map_copy(map_path)) {
         fprintf(stderr, "Failed to load map '%s' for editing\n", map_path);
         exit(1);
     }
@@ -315,26 +356,26 @@ void edit(char *map_path) {
     //check if the anthill is present on the map
     for (int i = 0; i < g_map.height; i++) {
         for (int j = 0; j < g_map.width; j++) {
-            if (g_map.matrix[i][j] == MAP_ANTHILL) {
-                if (g_map.matrix[i + 1][j + 0] == MAP_ANTHILL &&
-                    g_map.matrix[i + 2][j + 0] == MAP_ANTHILL &&
-                    g_map.matrix[i + 0][j + 1] == MAP_ANTHILL &&
-                    g_map.matrix[i + 1][j + 1] == MAP_ANTHILL &&
-                    g_map.matrix[i + 2][j + 1] == MAP_ANTHILL &&
-                    g_map.matrix[i + 0][j + 2] == MAP_ANTHILL &&
-                    g_map.matrix[i + 1][j + 2] == MAP_ANTHILL &&
-                    g_map.matrix[i + 2][j + 2] == MAP_ANTHILL) {
+            if (MAP_TILE(j, i) == MAP_ANTHILL) {
+                if (MAP_TILE(j + 0, i + 1) == MAP_ANTHILL &&
+                    MAP_TILE(j + 0, i + 2) == MAP_ANTHILL &&
+                    MAP_TILE(j + 1, i + 0) == MAP_ANTHILL &&
+                    MAP_TILE(j + 1, i + 1) == MAP_ANTHILL &&
+                    MAP_TILE(j + 1, i + 2) == MAP_ANTHILL &&
+                    MAP_TILE(j + 2, i + 0) == MAP_ANTHILL &&
+                    MAP_TILE(j + 2, i + 1) == MAP_ANTHILL &&
+                    MAP_TILE(j + 2, i + 2) == MAP_ANTHILL) {
                         g_anthill.y = i * CELL_SIZE;
                         g_anthill.x = j * CELL_SIZE;
-                        g_map.matrix[i + 0][j + 0] = MAP_FREE;
-                        g_map.matrix[i + 1][j + 0] = MAP_FREE;
-                        g_map.matrix[i + 2][j + 0] = MAP_FREE;
-                        g_map.matrix[i + 0][j + 1] = MAP_FREE;
-                        g_map.matrix[i + 1][j + 1] = MAP_FREE;
-                        g_map.matrix[i + 2][j + 1] = MAP_FREE;
-                        g_map.matrix[i + 0][j + 2] = MAP_FREE;
-                        g_map.matrix[i + 1][j + 2] = MAP_FREE;
-                        g_map.matrix[i + 2][j + 2] = MAP_FREE;
+                        MAP_TILE(j + 0, i + 0) = MAP_FREE;
+                        MAP_TILE(j + 0, i + 1) = MAP_FREE;
+                        MAP_TILE(j + 0, i + 2) = MAP_FREE;
+                        MAP_TILE(j + 1, i + 0) = MAP_FREE;
+                        MAP_TILE(j + 1, i + 1) = MAP_FREE;
+                        MAP_TILE(j + 1, i + 2) = MAP_FREE;
+                        MAP_TILE(j + 2, i + 0) = MAP_FREE;
+                        MAP_TILE(j + 2, i + 1) = MAP_FREE;
+                        MAP_TILE(j + 2, i + 2) = MAP_FREE;
                         goto out;
             }
                 else {
@@ -370,7 +411,7 @@ void edit(char *map_path) {
                                 }
                             }
                             else {
-                                g_map.matrix[y / CELL_SIZE][x / CELL_SIZE] = cur_mode;
+                                set_map_tile(x / CELL_SIZE, y / CELL_SIZE, cur_mode);
                             }
                         }
                             
@@ -379,7 +420,7 @@ void edit(char *map_path) {
                         rmb_pressed = true;
                         int x = event.button.x + g_camera.x, y = event.button.y + g_camera.y; 
                         if (x > 0 && x < level_width && y > 0 && y < level_height)
-                            g_map.matrix[y / CELL_SIZE][x / CELL_SIZE] = MAP_FREE;
+                            set_map_tile(x / CELL_SIZE, y / CELL_SIZE, MAP_FREE);
                     }
                     break;
                 case SDL_MOUSEBUTTONUP:
@@ -400,12 +441,12 @@ void edit(char *map_path) {
                     else if (lmb_pressed && cur_mode != MAP_ANTHILL) {
                         int x = event.motion.x + g_camera.x, y = event.motion.y + g_camera.y; 
                         if (x > 0 && x < level_width && y > 0 && y < level_height)
-                            g_map.matrix[y / CELL_SIZE][x / CELL_SIZE] = cur_mode;
+                            set_map_tile(x / CELL_SIZE, y / CELL_SIZE, cur_mode);
                     }
                     else if (rmb_pressed) {
                         int x = event.motion.x + g_camera.x, y = event.motion.y + g_camera.y; 
                         if (x > 0 && x < level_width && y > 0 && y < level_height)
-                            g_map.matrix[y / CELL_SIZE][x / CELL_SIZE] = MAP_FREE;
+                            set_map_tile(x / CELL_SIZE, y / CELL_SIZE, MAP_FREE);
                     }
                     break;
                 case SDL_KEYDOWN:
@@ -473,24 +514,20 @@ void edit(char *map_path) {
         }
         SDL_SetRenderDrawColor(g_renderer, 0x00, 0x60, 0x00, 0xFF);
         SDL_RenderClear(g_renderer);
-        for (int y = 0; y < level_height; y += g_background_texture.height) {
-            for (int x = 0; x < level_width; x += g_background_texture.width) {
-                SDL_Rect coords = {
-                    x,
-                    y,
-                    g_background_texture.width,
-                    g_background_texture.height
-                };
-                if (check_collision(coords, g_camera)) {
-                    render_texture(g_background_texture, x - g_camera.x, y - g_camera.y, 1);
-                }
+        //only the background tiles under the camera
+        int bg_x1 = (min(g_camera.x + g_camera.w, level_width) + g_background_texture.width - 1) / g_background_texture.width;
+        int bg_y1 = (min(g_camera.y + g_camera.h, level_height) + g_background_texture.height - 1) / g_background_texture.height;
+        for (int y = max(g_camera.y, 0) / g_background_texture.height; y < bg_y1; y++) {
+            for (int x = max(g_camera.x, 0) / g_background_texture.width; x < bg_x1; x++) {
+                render_texture(g_background_texture, x * g_background_texture.width - g_camera.x,
+                               y * g_background_texture.height - g_camera.y, 1);
             }
         }
 
         SDL_SetRenderDrawColor(g_renderer, 0x00, 0x90, 0x00, 0xFF);
         for (int i = 0; i < min((g_camera.y + g_camera.h + CELL_SIZE) / CELL_SIZE, g_map.height); i++) {
             for (int j = 0; j < min((g_camera.x + g_camera.w + CELL_SIZE) / CELL_SIZE, g_map.width); j++) {
-                if (g_map.matrix[i][j] == MAP_WALL) {
+                if (MAP_TILE(j, i) == MAP_WALL) {
                     SDL_Rect coords = {
                         j * CELL_SIZE - g_camera.x,
                         i * CELL_SIZE - g_camera.y,
@@ -499,10 +536,10 @@ void edit(char *map_path) {
                     };
                     SDL_RenderFillRect(g_renderer, &coords);
                 }
-                else if (g_map.matrix[i][j] == MAP_FOOD) {
+                else if (MAP_TILE(j, i) == MAP_FOOD) {
                     render_texture(g_leaf_texture, j * CELL_SIZE - g_camera.x, i * CELL_SIZE - g_camera.y, (float) CELL_SIZE / g_leaf_texture.width * world_scale);
                 }
-                else if (g_map.matrix[i][j] == MAP_ENCLOSED) {
+                else if (MAP_TILE(j, i) == MAP_ENCLOSED) {
                     SDL_Rect coords = {
                         j * CELL_SIZE - g_camera.x,
                         i * CELL_SIZE - g_camera.y,
@@ -516,7 +553,7 @@ void edit(char *map_path) {
                     SDL_SetRenderDrawColor(g_renderer, 0x00, 0x90, 0x00, 0xFF);
 #endif
                 }
-                else if (g_map.matrix[i][j] == MAP_ANTHILL) {
+                else if (MAP_TILE(j, i) == MAP_ANTHILL) {
                     SDL_Rect coords = {
                         j * CELL_SIZE - g_camera.x,
                         i * CELL_SIZE - g_camera.y,
@@ -553,9 +590,11 @@ int *get_map_info() {
 
     int *tile_counts = malloc(MAP_TOTAL * sizeof(int));
     memset(tile_counts, 0, MAP_TOTAL * sizeof(int));
-    for (int i = 0; i < g_map.height; i++)
+    for (int i = 0; i < g_map.height; i++) {
+        int8_t *row = MAP_ROW(g_map, i);
         for (int j = 0; j < g_map.width; j++)
-            tile_counts[g_map.matrix[i][j]]++;
+            tile_counts[row[j]]++;
+    }
     return tile_counts;
 }
 
@@ -568,55 +607,38 @@ bool isnumber(char *str) {
 }
 
 bool create_map(char *name, int width, int height) {
-    if (width > 255 || height > 255) {
-        fprintf(stderr, "Width and height greater than 255 are not supported\n");
+    if (width > MAP_MAX_SIDE || height > MAP_MAX_SIDE) {
+        fprintf(stderr, "Width and height greater than %d are not supported\n", MAP_MAX_SIDE);
         return false;
     }
-    int8_t *map[height];
-    int8_t zeros[width];
-    memset(zeros, 0, width * sizeof(int8_t));
-
-    for (int i = 0; i < height; i++) {
-        //get a pointer to the first element
-        map[i] = &zeros[0];
+    if (!alloc_map(&g_map, width, height)) {
+        fprintf(stderr, "Could not allocate a %dx%d map\n", width, height);
+        return false;
     }
-    g_map.matrix = map;
-    g_map.width = width;
-    g_map.height = height;
-    return write_map_to_file(name);
+    bool written = write_map_to_file(name);
+    destroy_map(&g_map);
+    return written;
 }
 
 bool resize(int dx, int dy) {
     int new_width = g_map.width + dx;
     int new_height = g_map.height + dy;
-    if (new_height < g_map.height) {
-        for (int i = new_height; i < g_map.height; i++) {
-            free(g_map.matrix[i]);
-        }
+    if (new_width <= 0 || new_height <= 0 || new_width > MAP_MAX_SIDE || new_height > MAP_MAX_SIDE) {
+        fprintf(stderr, "The map can not be resized to %dx%d\n", new_width, new_height);
+        return false;
     }
-    for (int i = 0; i < ((new_height < g_map.height) ? new_height: g_map.height); i++) {
-        if ((g_map.matrix[i] = realloc(g_map.matrix[i], sizeof(int8_t) * new_width)) == NULL) {
-            fprintf(stderr, "realloc failed\n");
-            return false;
-        };
-        if (new_width > g_map.width) {
-            memset(g_map.matrix[i] + g_map.width, 0, dx);
-        }
+    Map resized = {0};
+    //the stride may change, so copy the overlapping part into a new buffer
+    if (!alloc_map(&resized, new_width, new_height)) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
     }
-    if ((g_map.matrix = realloc(g_map.matrix, sizeof(int8_t *) * new_height)) == NULL) {
-            fprintf(stderr, "realloc failed\n");
-            return false;
+    for (int i = 0; i < min(new_height, g_map.height); i++) {
+        memcpy(MAP_ROW(resized, i), MAP_ROW(g_map, i), min(new_width, g_map.width));
     }
-    if (new_height > g_map.height) {
-        for (int i = g_map.height; i < new_height; i++) {
-            if ((g_map.matrix[i] = calloc(new_width, sizeof(int8_t))) == NULL) {
-                    fprintf(stderr, "malloc failed\n");
-                    return false;
-            }
-        }
-    }
-    g_map.height = new_height;
-    g_map.width = new_width;
+    resized.encoding = g_map.encoding;
+    destroy_map(&g_map);
+    g_map = resized;
     return true;
 }
 
@@ -638,8 +660,10 @@ int main (int argc, char *argv[]) {
             usage();
         }
         else {
+            //only reads the tiles, so the file can stay mapped
             if (load_map(*argv)) {
-                printf("%s: %dx%d\n", *argv, g_map.width, g_map.height);
+                printf("%s: %dx%d, version %d, %s encoding\n", *argv, g_map.width, g_map.height,
+                       g_map.version, encoding_to_string(g_map.encoding));
                 int *info = get_map_info();
                 for (int i = 0; i < MAP_TOTAL; i++) {
                     if (info[i] > 0)
@@ -665,7 +689,8 @@ int main (int argc, char *argv[]) {
             printf("Height cannot be 0!\n");
             exit(1);
         }
-        create_map(*argv, width, height);
+        if (!create_map(*argv, width, height))
+            exit(1);
         printf("%dx%d map '%s' created successfully\n", width, height, *argv);
         
     }
@@ -673,7 +698,7 @@ int main (int argc, char *argv[]) {
         if (*++argv == NULL || argv[1] == NULL || argv[2] == NULL)
             usage();
         int dx = atoi(argv[1]), dy = atoi(argv[2]);
-        if (!load_map(*argv)) {
+        if (!load_map_copy(*argv)) {
             fprintf(stderr, "Could not load '%s'", *argv);
             exit(1);
         };
@@ -691,17 +716,39 @@ int main (int argc, char *argv[]) {
         if (*++argv == NULL || argv[1] == NULL || argv[2] == NULL)
             usage();
         int x = atoi(argv[1]), y = atoi(argv[2]);
-        if (!load_map(*argv)) {
+        if (!load_map_copy(*argv)) {
             fprintf(stderr, "Could not load %s", *argv);
             exit(1);
         };
-        translate(x, y);
+        if (!translate(x, y)) {
+            fprintf(stderr, "Could not translate '%s'", *argv);
+            exit(1);
+        }
         if (!write_map_to_file(*argv)) {
             fprintf(stderr, "Could not write the map to file %s", *argv);
             exit(1);
         }
         printf("Map '%s' translated by %d and %d successfully\n", *argv, x, y);
     }
+    else if (strcmp("convert", *argv) == 0) {
+        if (*++argv == NULL || argv[1] == NULL)
+            usage();
+        enum MAP_ENCODING encoding = string_to_encoding(argv[1]);
+        if (encoding == MAP_ENCODINGS_NUM) {
+            fprintf(stderr, "Unknown encoding '%s'\n", argv[1]);
+            exit(1);
+        }
+        if (!load_map_copy(*argv)) {
+            fprintf(stderr, "Could not load %s", *argv);
+            exit(1);
+        };
+        g_map.encoding = encoding;
+        if (!write_map_to_file(*argv)) {
+            fprintf(stderr, "Could not write the map to file %s", *argv);
+            exit(1);
+        }
+        printf("Map '%s' converted to %s encoding\n", *argv, argv[1]);
+    }
     else if(strcmp("help", *argv) == 0 || strcmp("-help", *argv) == 0 || strcmp("--help", *argv) == 0) {
         usage();
     }
@@ -0,0 +1,214 @@
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+#include "food_distance.h"
+#include "cants_config.h"
+
+FoodDistance g_food_distance = {0};
+
+//the 8 directions an ant steps in
+static const int g_neighbour_dx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const int g_neighbour_dy[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+
+#if FOOD_DISTANCE && !MAP_STREAMING
+static bool passable(int32_t tile) {
+    int8_t type = MAP_TILE(tile % g_map.width, tile / g_map.width);
+    return type != MAP_WALL && type != MAP_ANTHILL;
+}
+
+//the neighbour of tile in direction d or -1 if it is off the map
+static int32_t neighbour(const FoodDistance *field, int32_t tile, int d) {
+    int x = tile % field->width + g_neighbour_dx[d], y = tile / field->width + g_neighbour_dy[d];
+    if (x < 0 || y < 0 || x >= field->width || y >= field->height) return -1;
+    return y * field->width + x;
+}
+
+static void grow_queue(FoodDistance *field, size_t count) {
+    if (count <= field->queue_capacity) return;
+    size_t capacity = field->queue_capacity ? field->queue_capacity : 256;
+    while (capacity < count) capacity *= 2;
+    int32_t *queue = realloc(field->queue, capacity * sizeof *queue);
+    if (queue == NULL) {
+        SDL_Log("Error: could not allocate memory for the food distances\n");
+        exit(1);
+    }
+    field->queue = queue;
+    field->queue_capacity = capacity;
+}
+
+static void grow_pending(FoodDistance *field, size_t count) {
+    if (count <= field->pending_capacity) return;
+    size_t capacity = field->pending_capacity ? field->pending_capacity : 256;
+    while (capacity < count) capacity *= 2;
+    uint64_t *pending = realloc(field->pending, capacity * sizeof *pending);
+    if (pending == NULL) {
+        SDL_Log("Error: could not allocate memory for the food distances\n");
+        exit(1);
+    }
+    field->pending = pending;
+    field->pending_capacity = capacity;
+}
+
+//breadth first search from the queued tiles, whose distances are set, lowering distances only.
+//The sorted pending[0, seeds) tiles join the search when it reaches their distance, so the tiles
+//are still visited in the order of their distances and every one gets its final distance the first time.
+static void spread(FoodDistance *field, size_t queued, size_t seeds) {
+    size_t head = 0, seed = 0;
+    while (head < queued || seed < seeds) {
+        int32_t tile;
+        if (seed < seeds && (head == queued || (int32_t) (field->pending[seed] >> 32) <= field->distances[field->queue[head]])) {
+            tile = (int32_t) (field->pending[seed] & 0xFFFFFFFF);
+            //a seed that the search has already reached with a shorter distance
+            if ((int32_t) (field->pending[seed++] >> 32) != field->distances[tile]) continue;
+        }
+        else tile = field->queue[head++];
+        int32_t distance = field->distances[tile] + 1;
+        for (int d = 0; d < 8; d++) {
+            int32_t next = neighbour(field, tile, d);
+            if (next == -1 || field->distances[next] <= distance || !passable(next)) continue;
+            field->distances[next] = distance;
+            grow_queue(field, queued + 1);
+            field->queue[queued++] = next;
+        }
+    }
+}
+
+static int compare_pending(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+#if DEBUGMODE
+//an incremental update gone wrong would silently send the ants the wrong way
+static void debug_check(const FoodDistance *field) {
+    static int updates;
+    if (++updates % FOOD_DISTANCE_CHECK_UPDATES != 0) return;
+    if (!food_distance_check(field)) {
+        SDL_Log("Error: the food distances differ from those built from scratch\n");
+        exit(1);
+    }
+}
+#endif
+#endif
+
+bool food_distance_init(FoodDistance *field) {
+    food_distance_destroy(field);
+#if FOOD_DISTANCE && !MAP_STREAMING
+    size_t tiles = (size_t) g_map.width * g_map.height;
+    if ((field->distances = malloc(tiles * sizeof *field->distances)) == NULL) return false;
+    field->width = g_map.width;
+    field->height = g_map.height;
+    food_distance_rebuild(field);
+#endif
+    return true;
+}
+
+void food_distance_rebuild(FoodDistance *field) {
+    field->deferred = false;
+#if FOOD_DISTANCE && !MAP_STREAMING
+    if (field->distances == NULL) return;
+    size_t queued = 0;
+    for (int y = 0; y < g_map.height; y++) {
+        for (int x = 0; x < g_map.width; x++) {
+            int32_t tile = y * g_map.width + x;
+            field->distances[tile] = FOOD_DISTANCE_NONE;
+            if (MAP_TILE(x, y) == MAP_FOOD) {
+                field->distances[tile] = 0;
+                grow_queue(field, queued + 1);
+                field->queue[queued++] = tile;
+            }
+        }
+    }
+    spread(field, queued, 0);
+#endif
+}
+
+void food_distance_destroy(FoodDistance *field) {
+    free(field->distances);
+    free(field->queue);
+    free(field->pending);
+    *field = (FoodDistance) {0};
+}
+
+void food_distance_add(FoodDistance *field, int x, int y) {
+#if FOOD_DISTANCE && !MAP_STREAMING
+    if (field->distances == NULL || field->deferred) return;
+    int32_t tile = y * field->width + x;
+    field->distances[tile] = 0;
+    grow_queue(field, 1);
+    field->queue[0] = tile;
+    spread(field, 1, 0);
+#if DEBUGMODE
+    debug_check(field);
+#endif
+#else
+    (void) field;
+    (void) x;
+    (void) y;
+#endif
+}
+
+void food_distance_remove(FoodDistance *field, int x, int y) {
+#if FOOD_DISTANCE && !MAP_STREAMING
+    if (field->distances == NULL || field->deferred) return;
+    //the tiles that had the leaf as one of their nearest: reached from it by steps that each add 1
+    //to the distance, collected with their old distances and cleared
+    int32_t tile = y * field->width + x;
+    size_t cleared = 0;
+    grow_pending(field, 1);
+    field->pending[cleared++] = tile;
+    field->distances[tile] = FOOD_DISTANCE_NONE;
+    for (size_t i = 0; i < cleared; i++) {
+        int32_t from = (int32_t) (field->pending[i] & 0xFFFFFFFF);
+        int32_t distance = (int32_t) (field->pending[i] >> 32) + 1;
+        for (int d = 0; d < 8; d++) {
+            int32_t next = neighbour(field, from, d);
+            if (next == -1 || field->distances[next] != distance) continue;
+            grow_pending(field, cleared + 1);
+            field->pending[cleared++] = (uint64_t) distance << 32 | (uint32_t) next;
+            field->distances[next] = FOOD_DISTANCE_NONE;
+        }
+    }
+    //every cleared tile starts from the best neighbour that kept its distance (if any)
+    size_t seeds = 0;
+    for (size_t i = 0; i < cleared; i++) {
+        int32_t cleared_tile = (int32_t) (field->pending[i] & 0xFFFFFFFF);
+        int32_t best = FOOD_DISTANCE_NONE;
+        for (int d = 0; d < 8; d++) {
+            int32_t next = neighbour(field, cleared_tile, d);
+            if (next != -1 && field->distances[next] < best) best = field->distances[next];
+        }
+        if (best == FOOD_DISTANCE_NONE) continue;
+        field->pending[seeds++] = (uint64_t) (best + 1) << 32 | (uint32_t) cleared_tile;
+    }
+    for (size_t i = 0; i < seeds; i++) {
+        field->distances[field->pending[i] & 0xFFFFFFFF] = (int32_t) (field->pending[i] >> 32);
+    }
+    qsort(field->pending, seeds, sizeof *field->pending, compare_pending);
+    spread(field, 0, seeds);
+#if DEBUGMODE
+    debug_check(field);
+#endif
+#else
+    (void) field;
+    (void) x;
+    (void) y;
+#endif
+}
+
+bool food_distance_check(const FoodDistance *field) {
+    if (field->distances == NULL || field->deferred) return true;
+    size_t size = (size_t) field->width * field->height * sizeof *field->distances;
+    FoodDistance rebuilt = {0};
+    if ((rebuilt.distances = malloc(size)) == NULL) {
+        SDL_Log("Warning: could not allocate memory to check the food distances\n");
+        return true;
+    }
+    rebuilt.width = field->width;
+    rebuilt.height = field->height;
+    food_distance_rebuild(&rebuilt);
+    bool same = memcmp(rebuilt.distances, field->distances, size) == 0;
+    food_distance_destroy(&rebuilt);
+    return same;
+}
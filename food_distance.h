@@ -0,0 +1,51 @@
+#ifndef FOOD_DISTANCE_H
+#define FOOD_DISTANCE_H 1
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Distance to food - the number of steps (in any of the 8 directions an ant moves in) from every tile
+//to the nearest leaf, walls and the anthill excluded. Built once with a breadth first search
+//from all leaves and then kept up to date as leaves come and go (create_food and remove_food),
+//so that an npc finds its way to a leaf by stepping to a neighbour with a smaller distance.
+//A new leaf only lowers the distances around it until they meet those of other leaves. A picked up
+//leaf raises the distances of the tiles that had it as (one of) their nearest leaves: those are
+//cleared and filled in again from the tiles around them that kept their distance.
+//Not used with MAP_STREAMING or with FOOD_DISTANCE set to 0 (see cants_config.h).
+
+//no leaf can be reached from the tile (or it is a wall or the anthill)
+#define FOOD_DISTANCE_NONE INT32_MAX
+
+typedef struct {
+    int32_t *distances; //width x height, row major
+    int width;
+    int height;
+    //work lists of the updates, grown as needed
+    int32_t *queue;
+    uint64_t *pending; //distance << 32 | tile
+    size_t queue_capacity;
+    size_t pending_capacity;
+    bool deferred; //changes are not tracked until the next food_distance_rebuild
+} FoodDistance;
+
+extern FoodDistance g_food_distance;
+
+//(re)build the field for the leaves on g_map, does nothing when the field is not used
+bool food_distance_init(FoodDistance *field);
+void food_distance_destroy(FoodDistance *field);
+//compute the whole field again from the leaves on g_map, for when many leaves change at once (with deferred set)
+void food_distance_rebuild(FoodDistance *field);
+
+//the field must exist
+static inline int32_t food_distance_at(const FoodDistance *field, int x, int y) {
+    if (x < 0 || y < 0 || x >= field->width || y >= field->height) return FOOD_DISTANCE_NONE;
+    return field->distances[(size_t) y * field->width + x];
+}
+//a leaf appeared on (x, y) / was picked up from (x, y), after the tile of g_map is changed
+void food_distance_add(FoodDistance *field, int x, int y);
+void food_distance_remove(FoodDistance *field, int x, int y);
+//whether the distances kept up to date so far are the same as those of a field built from scratch,
+//true if the field is not used (debug builds check it every FOOD_DISTANCE_CHECK_UPDATES updates)
+bool food_distance_check(const FoodDistance *field);
+#define FOOD_DISTANCE_CHECK_UPDATES 64
+#endif //FOOD_DISTANCE_H
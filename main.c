@@ -7,165 +7,51 @@
 #include <math.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "map.h"
+#include "npc.h"
+#include "pheromone.h"
+#include "food_distance.h"
+#include "sim.h"
+#include "render.h"
+#include "profiler.h"
+#include "tile_layer.h"
+#include "workers.h"
+#include "replay.h"
 #include "cants_config.h"
 
-#define scp(pointer, message) {                                               \
-    if (pointer == NULL) {                                                    \
-        SDL_Log("Error: %s! SDL_Error: %s", message, SDL_GetError()); \
-        exit(1);                                                              \
-    }                                                                         \
-}
-
-#define scc(code, message) {                                                  \
-    if (code < 0) {                                                           \
-        SDL_Log("Error: %s! SDL_Error: %s", message, SDL_GetError()); \
-        exit(1);                                                              \
-    }                                                                         \
-}
-
-// turn an integer literal into a string literal
-#define STR_IMPL_(x) #x      //stringify argument
-#define STR(x) STR_IMPL_(x)  //indirection to expand argument macros
-
-#define imgcp(pointer, message) { if (pointer == NULL) {SDL_Log("Error: %s! IMG_Error: %s", message, IMG_GetError()); exit(1);}}
-#define imgcc(code, message) { if (code < 0) {SDL_Log("Error: %s! IMG_Error: %s", message, IMG_GetError()); exit(1);}}
-#define ttfcp(pointer, message) { if (pointer == NULL) {SDL_Log("Error: %s! TTF_Error: %s", message, TTF_GetError()); exit(1);}}
-#define ttfcc(code, message) { if (code < 0) {SDL_Log("Error: %s! TTF_Error: %s", message, TTF_GetError()); exit(1);}}
-
-#define emod(a, b) (((a) % (b)) + (b)) % (b)
-
-int screen_width = 1920;
-int screen_height = 1080;
-int level_width = 3000;
-int level_height = 3000;
-const Uint32 ANT_ANIM_MS = 100;
-const Uint32 ANT_MS_TO_MOVE = 10;
-const int ANT_VEL_MAX = 2;
-const int ANT_TURN_DEGREES = 1;
-const int CELL_SIZE = 50;
-const int ANT_STEP_LEN = CELL_SIZE;
-const int TILES_PER_FOOD = 90;
-
-enum ANT_STATES {ANT_STATE_PREPARE, ANT_STATE_TURN, ANT_STATE_STEP};
-#if TUTORIAL
-enum TUTORIAL_STAGES {TUTORIAL_LEAVES, TUTORIAL_UPGRADE, TUTORIAL_TEN, TUTORIAL_DONE};
-#endif
-
-//Texture - an SDL_Texture with additional information
-typedef struct {
-    SDL_Texture *texture_proper;
-    int width;
-    int height;
-} Texture;
-
-//Ant structs hold information needed to draw any ant
-//Player and Npc structs are used to calculate motion. There is a sort of 'inheritance' from Ant
-
-typedef struct {
-    int8_t frame;
-    Uint32 anim_time;
-    float x;
-    float y;
-    int angle;
-    float scale;
-} Ant;
-
-typedef struct {
-    Ant *ant;
-    enum ANT_STATES state;
-    int target_angle;
-    int8_t cw;
-    int steps_done;
-    int gm_x; //game coordinates
-    int gm_y;
-    SDL_TimerID timer_id;
-} Npc;
-
-typedef struct {
-    Ant *ant;
-    int vel;
-    int turn_vel;
-    int width;
-    int height;
-    int food_count;
-    bool in_anthill;
-} Player;
-
-
-typedef struct {
-    int x;
-    int y;
-    int gm_x;
-    int gm_y;
-    int level;
-} Anthill;
+#define NPC_POOL_INIT_CAPACITY 64
+//the simulation drops ticks instead of catching up after stalls longer than that
+const Uint32 SIM_MAX_CATCHUP_MS = 250;
+//wall clock time a frame may spend on ticks, the rest are left for the next frames
+//so that a fast forwarded simulation never holds up input and rendering
+const Uint32 SIM_FRAME_BUDGET_MS = 10;
+//simulation speeds Tab cycles through, 0 runs as many ticks as fit in SIM_FRAME_BUDGET_MS
+const int g_time_scales[] = {1, 4, 16, 0};
+#define TIME_SCALES_NUM (int) (sizeof g_time_scales / sizeof g_time_scales[0])
 
 //////////////// GLOBALS ////////////////////////////////////////////////////////
 
-SDL_Window* g_window;
-
-SDL_Renderer* g_renderer;
-
-Uint32 g_eventstart;
-
-Texture g_leaf_texture;
-Texture g_background_texture;
-Texture g_ant_texture;
-Texture g_food_count_texture;
-Texture g_anthill_texture;
-Texture g_anthill_icon_texture;
-Texture g_anthill_level_texture;
-Texture g_tutorial_prompt;
-
-#if TUTORIAL
-enum TUTORIAL_STAGES g_tutorial = TUTORIAL_LEAVES;
-#endif
-TTF_Font *g_font;
-
-int g_world_food_count;
-
-//Ant frames clip rects
-#define ANT_FRAMES_NUM 4
-SDL_Rect g_antframes[ANT_FRAMES_NUM];
-
-//remember the inverted y axis
-Point g_ant_move_table[8] = {
-    {0, -1}, //0
-    {1, -1}, //45
-    {1,  0}, //90
-    {1,  1}, //135
-    {0,  1}, //180
-    {-1, 1}, //225
-    {-1, 0}, //270
-    {-1,-1}  //315
-};
+//point in time up to which the simulation has been accounted for
+Uint32 g_sim_time;
+//simulated ms that are due but have not been run yet
+Uint32 g_sim_backlog;
+//index into g_time_scales
+int g_time_scale;
 
-#define MAX_LEVEL 10
-//const int g_levels_table[MAX_LEVEL + 1] = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150, 160, 170, 180, 190, 200, 200};
-const int g_levels_table[MAX_LEVEL + 1] = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 100};
+//PRESENT_VSYNC waits for the display, the others don't (frames are interpolated either way, see g_render_alpha)
+//and PRESENT_LIMITED sleeps to keep to g_frame_limit frames per second
+enum PRESENT_MODES {PRESENT_VSYNC, PRESENT_UNCAPPED, PRESENT_LIMITED};
+enum PRESENT_MODES g_present_mode = PRESENT_VSYNC;
+int g_frame_limit;
+Uint64 g_last_present;
 
-SDL_Rect g_camera = {
-    0,
-    0,
-    0,
-    0
-};
-
-size_t g_npc_sp;
-Npc **g_npc_stack = NULL;
+//inputs of the game are written here with --record, closed when the map is left
+Replay g_recording;
 
 //////////////// FUNCTIONS //////////////////////////////////////////////////////
 
-//create a dynamically allocated stack which holds ants and is used for rendering them all
-Npc **init_npc_stack(void);
-//push an npc onto npc stack
-bool push_npc(Npc *npc);
-
-//check collision of two axis aligned rectangles
-bool check_collision(SDL_Rect x, SDL_Rect y);
-
 void init(void) {
 
 	scc(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER), "Could not initialize SDL");
@@ -187,7 +73,9 @@ void init(void) {
     g_camera.w = screen_width;
     g_camera.h = screen_height;
     //Create renderer for window
-    scp((g_renderer = SDL_CreateRenderer(g_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC)),
+    Uint32 renderer_flags = SDL_RENDERER_ACCELERATED;
+    if (g_present_mode == PRESENT_VSYNC) renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+    scp((g_renderer = SDL_CreateRenderer(g_window, -1, renderer_flags)),
             "Could not create renderer");
 
     int imgFlags = IMG_INIT_PNG;
@@ -195,508 +83,79 @@ void init(void) {
         SDL_Log("SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError());
         exit(1);
     }
-    //init stack with ant pointers
-    if ((g_npc_stack = init_npc_stack()) == NULL) {
-        SDL_Log("Error: Could not initialize ant stack!");
+    if (!npc_pool_init(&g_npcs, NPC_POOL_INIT_CAPACITY)) {
+        SDL_Log("Error: Could not initialize npc pool!");
         exit(1);
     }
-}
-
-//return Texture struct
-Texture load_texture(const char *path)
-{
-	//The final texture
-	SDL_Texture *new_texture = NULL;
-    SDL_Surface *loaded_surface = NULL;
-    Texture texture_struct = {0};
-
-	//Load image at specified path
-	imgcp((loaded_surface = IMG_Load(path)), "Could not load image");
-    //Create texture from surface pixels
-    scp((new_texture = SDL_CreateTextureFromSurface(g_renderer, loaded_surface)), "Could not create texture from surface");
-
-    texture_struct.texture_proper = new_texture;
-    texture_struct.width = loaded_surface->w;
-    texture_struct.height = loaded_surface->h;
-
-    //Get rid of old loaded surface
-    SDL_FreeSurface(loaded_surface);
-
-	return texture_struct;
-}
-
-Texture load_text_texture(const char *text){
-	SDL_Texture *new_texture = NULL;
-    SDL_Surface *text_surface = NULL;
-
-#define OUTLINE_SIZE 2
-    /* load font and its outline */
-    TTF_SetFontOutline(g_font, OUTLINE_SIZE);
-
-    /* render text and text outline */
-    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
-    SDL_Color black = {0x00, 0x00, 0x00, 0xFF};
-    text_surface = TTF_RenderText_Blended(g_font, text, black);
-    SDL_Surface *fg_surface = TTF_RenderText_Blended(g_font, text, white);
-    SDL_Rect rect = {OUTLINE_SIZE, OUTLINE_SIZE, fg_surface->w, fg_surface->h};
-
-    /* blit text onto its outline */
-    SDL_SetSurfaceBlendMode(fg_surface, SDL_BLENDMODE_BLEND);
-    SDL_BlitSurface(fg_surface, NULL, text_surface, &rect);
-    SDL_FreeSurface(fg_surface);
-
-    scp((new_texture = SDL_CreateTextureFromSurface(g_renderer, text_surface)), "Could not create texture from surface");
-
-    const Texture texture_struct = {
-        new_texture,
-        text_surface->w,
-        text_surface->h
-
-    };
-    SDL_FreeSurface(text_surface);
-
-	return texture_struct;
-}
-
-void load_media() {
-    g_ant_texture = load_texture(ASSETS_PREFIX"antspritesheet.png");
-    for (int i = 0; i < ANT_FRAMES_NUM; i++) {
-        g_antframes[i].x = g_ant_texture.width * i / ANT_FRAMES_NUM;
-        g_antframes[i].y = 0;
-        g_antframes[i].h = g_ant_texture.height;
-        g_antframes[i].w = g_ant_texture.width / ANT_FRAMES_NUM;
+    //the simulation still runs (on the main thread alone) without them
+    if (!workers_init(0)) {
+        SDL_Log("Warning: Could not start worker threads\n");
     }
-    g_background_texture = load_texture(ASSETS_PREFIX"grass500x500.png");
-    //"https://www.freepik.com/vectors/cartoon-grass" Cartoon grass vector created by babysofja - www.freepik.com
-    g_leaf_texture = load_texture(ASSETS_PREFIX"leaf.png");
-    g_font = TTF_OpenFont(ASSETS_PREFIX"OpenSans-Regular.ttf", 50);
-    assert(g_levels_table[0] == 10 && "wrong first level in a texture");
-    g_food_count_texture = load_text_texture("0/10");
-    g_anthill_texture = load_texture(ASSETS_PREFIX"anthill.png");
-    g_anthill_icon_texture = load_texture(ASSETS_PREFIX"anthill_icon.png");
-    g_anthill_level_texture = load_text_texture("1/"STR(MAX_LEVEL));
-    g_tutorial_prompt = load_text_texture("Use WASD to move around and collect leaves");
 }
 
-void closesdl()
-{
-	//Free loaded image
-	SDL_DestroyTexture(g_ant_texture.texture_proper);
-    g_ant_texture.texture_proper = NULL;
-    SDL_DestroyTexture(g_background_texture.texture_proper);
-    g_background_texture.texture_proper = NULL;
-    SDL_DestroyTexture(g_leaf_texture.texture_proper);
-    g_background_texture.texture_proper = NULL;
-    SDL_DestroyTexture(g_food_count_texture.texture_proper);
-    g_background_texture.texture_proper = NULL;
-    SDL_DestroyTexture(g_anthill_texture.texture_proper);
-    g_background_texture.texture_proper = NULL;
-    SDL_DestroyTexture(g_anthill_icon_texture.texture_proper);
-
-	SDL_DestroyRenderer(g_renderer);
-	SDL_DestroyWindow(g_window);
-	g_window = NULL;
-	g_renderer = NULL;
-
-    TTF_CloseFont(g_font);
-	//Quit SDL subsystems
-	IMG_Quit();
-    TTF_Quit();
-	SDL_Quit();
-}
-
-Ant *create_ant(int x, int y) {
-    Ant *ant = malloc(sizeof(Ant));
-    if (ant == NULL) {
-        return NULL;
+//leaves picked up since the last frame are counted and respawned all at once
+void apply_pickups(Player *player, Anthill *anthill) {
+    int pickups = pickup_queue_drain(&g_pickup_queue, NULL, 0, NULL);
+    if (pickups == 0) return;
+    //only friendly ants currently
+    player->food_count += pickups;
+    update_food_count_text(player->food_count, g_levels_table[anthill->level]);
+    replay_write(&g_recording, (ReplayEvent) {.type = REPLAY_PICKUPS, .tick = g_sim_ticks, .view = g_camera});
+    for (int i = 0; i < pickups; i++) {
+        create_food(g_camera);
     }
-    memset((void *) ant, 0, sizeof(Ant));
-    ant->anim_time = SDL_GetTicks();
-    ant->x = x;
-    ant->y = y;
-
-    ant->scale = (double) rand() / RAND_MAX + 0.75;
-#if DEBUGMODE
-    SDL_Log("Ant #%ld created at x %d y %d\n", g_npc_sp, (int) ant->x, (int) ant->y);
-#endif
-    return ant;
 }
 
-void render_player_anim(Player *player) {
-    if (SDL_GetTicks() - player->ant->anim_time > ANT_ANIM_MS && (player->vel != 0 || player->turn_vel != 0)) {
-        player->ant->anim_time = SDL_GetTicks();
-        player->ant->frame = (player->ant->frame + 1) % ANT_FRAMES_NUM;
+//run as many ANT_MS_TO_MOVE ticks as have passed since the last call (times the time scale)
+//on the main thread, but no longer than SIM_FRAME_BUDGET_MS. Only the state after the last tick
+//gets drawn, leaves picked up in between are counted and respawned by apply_pickups afterwards
+void run_simulation(Player *player, Anthill *anthill) {
+    Uint32 now = SDL_GetTicks();
+    Uint32 elapsed = now - g_sim_time;
+    if (elapsed > SIM_MAX_CATCHUP_MS) {
+        elapsed = SIM_MAX_CATCHUP_MS;
     }
-    SDL_Rect render_rect = {
-        .x = player->ant->x - g_camera.x - g_ant_texture.width * player->ant->scale / ANT_FRAMES_NUM / 2,
-        .y = player->ant->y - g_camera.y - g_ant_texture.height * player->ant->scale / 2,
-        .w = g_antframes[0].w * player->ant->scale,
-        .h = g_antframes[0].h * player->ant->scale,
-    };
-    SDL_RenderCopyEx(g_renderer, g_ant_texture.texture_proper, &g_antframes[player->ant->frame], &render_rect, player->ant->angle, NULL, SDL_FLIP_NONE);
-
-}
-
-void render_ant_anim(Ant *ant) {
-    if (SDL_GetTicks() - ant->anim_time > ANT_ANIM_MS) {
-        ant->anim_time = SDL_GetTicks();
-        ant->frame = (ant->frame + 1) % ANT_FRAMES_NUM;
+    g_sim_time = now;
+    int scale = g_time_scales[g_time_scale];
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 budget = SDL_GetPerformanceFrequency() * SIM_FRAME_BUDGET_MS / 1000;
+    if (scale == 0) {
+        g_sim_backlog = 0;
+        do {
+            sim_tick(player, anthill);
+        } while (SDL_GetPerformanceCounter() - start < budget);
+        g_render_alpha = 1;
+        return;
     }
-    SDL_Rect render_rect = {
-        .x = ant->x - g_camera.x - g_ant_texture.width * ant->scale / ANT_FRAMES_NUM / 2,
-        .y = ant->y - g_camera.y - g_ant_texture.height * ant->scale / 2,
-        .w = g_antframes[0].w * ant->scale,
-        .h = g_antframes[0].h * ant->scale,
-    };
-    SDL_RenderCopyEx(g_renderer, g_ant_texture.texture_proper, &g_antframes[ant->frame], &render_rect, ant->angle, NULL, SDL_FLIP_NONE);
-}
 
-void render_texture(Texture texture, int x, int y) {
-    SDL_Rect render_rect;
-    render_rect.x = x;
-    render_rect.y = y;
-    render_rect.h = texture.height;
-    render_rect.w = texture.width;
-    SDL_RenderCopy(g_renderer, texture.texture_proper, NULL, &render_rect);
-}
-
-void render_texture_scaled(Texture texture, int x, int y, float scale) {
-    SDL_Rect render_rect;
-    render_rect.x = x;
-    render_rect.y = y;
-    render_rect.h = texture.height * scale;
-    render_rect.w = texture.width * scale;
-    SDL_RenderCopy(g_renderer, texture.texture_proper, NULL, &render_rect);
-}
-
-void set_camera(Player *player) {
-    //Center the camera over the player
-    g_camera.x = ((int) player->ant->x + g_ant_texture.width / (2 * ANT_FRAMES_NUM)) - screen_width / 2;
-    g_camera.y = ((int) player->ant->y + g_ant_texture.height / 2) - screen_height / 2;
-
-    //Keep the camera in bounds
-    if(g_camera.x < 0) {
-        g_camera.x = 0;
-    }
-    if(g_camera.y < 0) {
-        g_camera.y = 0;
-    }
-    if(g_camera.x > level_width - g_camera.w) {
-        g_camera.x = level_width - g_camera.w;
+    g_sim_backlog += elapsed * scale;
+    //a backlog the budget can't keep up with is dropped like a stall
+    if (g_sim_backlog > SIM_MAX_CATCHUP_MS * scale) {
+        g_sim_backlog = SIM_MAX_CATCHUP_MS * scale;
     }
-    if(g_camera.y > level_height - g_camera.h) {
-        g_camera.y = level_height - g_camera.h;
+    while (g_sim_backlog >= ANT_MS_TO_MOVE && SDL_GetPerformanceCounter() - start < budget) {
+        sim_tick(player, anthill);
+        g_sim_backlog -= ANT_MS_TO_MOVE;
     }
+    //the part of the next tick that is already due
+    g_render_alpha = SDL_min((float) g_sim_backlog / ANT_MS_TO_MOVE, 1.0f);
 }
 
-void remove_food(int8_t *cell) {
-    *cell = MAP_FREE;
-    SDL_Event event;
-    SDL_UserEvent userevent;
-    event.type = SDL_USEREVENT;
-    userevent.type = g_eventstart;
-    event.user = userevent;
-    SDL_PushEvent(&event);
-}
-
-Uint32 move_player(Uint32 interval, void *player_void) {
-    Player *player = (Player *) player_void;
-
-    if (player->vel >= 0)
-        player->ant->angle += player->turn_vel;
-    else
-        player->ant->angle -= player->turn_vel;
-
-    if (player->vel != 0) {
-                                        //convert angle to radians
-        float dx = cosf((player->ant->angle - 90) * M_PI / 180.0);
-        float dy = sinf((player->ant->angle - 90) * M_PI / 180.0);
-        player->ant->x += player->vel * dx;
-        player->ant->y += player->vel * dy;
-        //collision checks
-        //TODO: accessing the map with the player outside of the map may segfault
-        //Circular collision might be worth it
-        int8_t *cell = &g_map.matrix[(int) player->ant->y / CELL_SIZE][(int) player->ant->x / CELL_SIZE];
-        switch (*cell) {
-            case MAP_FREE:
-                player->in_anthill = false;
-                break;
-            case MAP_ANTHILL:
-                player->in_anthill = true;
-                /* FALLTHRU */
-            case MAP_WALL:
-                player->ant->x -= player->vel * dx;
-                player->ant->y -= player->vel * dy;
-                break;
-            case MAP_FOOD:
-                remove_food(cell);
-                break;
-        }
+void present_frame(void) {
+    SDL_RenderPresent(g_renderer);
+    if (g_present_mode == PRESENT_LIMITED) {
+        Uint64 frequency = SDL_GetPerformanceFrequency();
+        Uint64 frame = frequency / g_frame_limit;
+        Uint64 elapsed = SDL_GetPerformanceCounter() - g_last_present;
+        if (elapsed < frame) SDL_Delay((frame - elapsed) * 1000 / frequency);
     }
-
-
-    return interval;
+    g_last_present = SDL_GetPerformanceCounter();
 }
 
-void update_food_count_texture(int food_count, int next_level) {
-    char str[22];
-    sprintf(str, "%d/%d", food_count, next_level);
-    SDL_DestroyTexture(g_food_count_texture.texture_proper);
-    g_food_count_texture = load_text_texture(str);
-}
-void update_anthill_level_texture(int level) {
-    char str[22];
-    sprintf(str, "%d/%d", level, MAX_LEVEL);
-    SDL_DestroyTexture(g_anthill_level_texture.texture_proper);
-    g_anthill_level_texture = load_text_texture(str);
-}
-
-Uint32 move_npc(Uint32 interval, void *npc_void) {
-
-    Npc *npc = (Npc *) npc_void;
-    switch (npc->state) {
-        case ANT_STATE_PREPARE:;
-
-            Point target_cell = {-1, -1};
-
-            for (int i = 0; i < 8; i++) {
-                int gm_x = npc->gm_x + g_ant_move_table[i].x;
-                int gm_y = npc->gm_y + g_ant_move_table[i].y;
-                if (g_map.matrix[gm_y][gm_x] == MAP_FOOD) {
-                    target_cell.x = gm_x;
-                    target_cell.y = gm_y;
-                    npc->target_angle = i * 45;
-                }
-            }
-            if (target_cell.x == -1) {
-                //no leaf, choose random cell
-                do {
-                int n = rand() % 8;
-                Point random_offset = g_ant_move_table[n];
-                npc->target_angle = n * 45;
-                target_cell.x = npc->gm_x + random_offset.x;
-                target_cell.y = npc->gm_y + random_offset.y;
-                } 
-                while (g_map.matrix[target_cell.y][target_cell.x] == MAP_WALL || g_map.matrix[target_cell.y][target_cell.x] == MAP_ANTHILL);
-            }
-            npc->gm_x = target_cell.x;
-            npc->gm_y = target_cell.y;
-            npc->steps_done = 0;
-
-            if ((npc->ant->angle > npc->target_angle && npc->ant->angle - npc->target_angle > 180) ||
-                    (npc->target_angle > npc->ant->angle && npc->target_angle - npc->ant->angle < 180)) npc->cw = 1;
-            else npc->cw = -1;
-
-            npc->state = ANT_STATE_TURN;
-
-            //TODO: may segfault on boundary of the map
-            break;
-
-        case ANT_STATE_TURN:
-
-            if (emod(npc->ant->angle, 360) != npc->target_angle) {
-                npc->ant->angle = emod(npc->ant->angle + 5 * npc->cw, 360);
-            }
-            else
-                npc->state = ANT_STATE_STEP;
-            break;
-        case ANT_STATE_STEP:
-            if (npc->steps_done < ANT_STEP_LEN) {
-                npc->steps_done++;
-                float rad = (npc->ant->angle - 90) * M_PI / 180.0;
-                if (npc->ant->angle % 90 == 0) {
-                    npc->ant->x += cosf(rad);
-                    npc->ant->y += sinf(rad);
-                }
-                else {
-                    npc->ant->x += cosf(rad) * M_SQRT2;
-                    npc->ant->y += sinf(rad) * M_SQRT2;
-                }
-            }
-            else {
-                //correction
-                npc->ant->x = npc->gm_x * CELL_SIZE + (float) CELL_SIZE / 2;
-                npc->ant->y = npc->gm_y * CELL_SIZE + (float) CELL_SIZE / 2;
-                int8_t *cell = &g_map.matrix[(int) npc->ant->y / CELL_SIZE][(int) npc->ant->x / CELL_SIZE];
-                if (*cell == MAP_FOOD) {
-                    remove_food(cell);
-                }
-                npc->state = ANT_STATE_PREPARE;
-            }
-            break;
-    }
-    return interval;
-}
-
-Npc *create_npc(int gm_x, int gm_y) {
-    Npc *npc = malloc(sizeof(Npc));
-    if (npc == NULL) return NULL;
-    npc->ant = create_ant((gm_x + 0.5) * CELL_SIZE, (gm_y + 0.5) * CELL_SIZE);
-    if (npc->ant == NULL) {
-        free(npc);
-        SDL_Log("Warning: Could not allocate memory for an npc ant");
-        return NULL;
-    }
-    if (!push_npc(npc)) {
-        SDL_Log("Warning: could not push npc ant\n");
-        free(npc->ant);
-        free(npc);
-        return NULL;
-    }
-    npc->gm_x = gm_x;
-    npc->gm_y = gm_y;
-    npc->state = ANT_STATE_PREPARE;
-    SDL_AddTimer(ANT_MS_TO_MOVE, move_npc, (void *) npc);
-    return npc;
-}
-
-void create_food(void) {
-    SDL_Rect leaf_rect = { 
-        .w = g_leaf_texture.width,
-        .h = g_leaf_texture.height
-    };
-    Point point;
-    do {
-    point = find_random_free_spot_on_a_map();
-    leaf_rect.x = point.x * CELL_SIZE;
-    leaf_rect.y = point.y * CELL_SIZE;
-    } while (check_collision(leaf_rect, g_camera));
-
-    g_map.matrix[point.y][point.x] = MAP_FOOD;
-    g_world_food_count++;
-}
-
-//coordinates of the entrance (where the ants spawn)
-void init_anthill(Anthill *anthill) {
-
-    anthill->level = 0;
-    for (int i = 0; i < g_map.height; i++) {
-        for (int j = 0; j < g_map.width; j++) {
-            if (g_map.matrix[i][j] == MAP_ANTHILL) {
-                anthill->gm_x = j + 1;
-                anthill->gm_y = i;
-                anthill->x = (anthill->gm_x - 1) * CELL_SIZE;
-                anthill->y = (anthill->gm_y) * CELL_SIZE;
-                return;
-            }
-        }
-    }
-    SDL_Log("The map does not contain an anthill\n");
-    exit(1);
-}
-
-
-Texture win(void) {
-Texture win_texture = load_text_texture("Congratulations! You won!");
-return win_texture;
-}
-
-void render_game_objects(Player *player, Anthill *anthill) {
-        SDL_SetRenderDrawColor(g_renderer, 0x00, 0x90, 0x00, 0xFF);
-        SDL_RenderClear(g_renderer);
-
-        //render background texture tiles (only those that are on the screen)
-        for (int y = 0; y < level_height; y += g_background_texture.height) {
-            for (int x = 0; x < level_width; x += g_background_texture.width) {
-                SDL_Rect coords = {
-                    x,
-                    y,
-                    g_background_texture.width,
-                    g_background_texture.height
-                };
-                if (check_collision(coords, g_camera)) {
-                    render_texture(g_background_texture, x - g_camera.x, y - g_camera.y);
-                }
-            }
-        }
-
-        render_player_anim(player);
-
-        //render ants which are on the screen
-        for (size_t i = 0; i < g_npc_sp; i++) {
-            SDL_Rect coords = {
-                g_npc_stack[i]->ant->x,
-                g_npc_stack[i]->ant->y,
-                g_ant_texture.width / ANT_FRAMES_NUM,
-                g_ant_texture.height
-            };
-            if (check_collision(coords, g_camera)) {
-                render_ant_anim(g_npc_stack[i]->ant);
-            }
-        }
-
-
-        for (int i = g_camera.y / CELL_SIZE; i < (g_camera.y + g_camera.h + CELL_SIZE) / CELL_SIZE && i < g_map.height; i++) {
-            for (int j = g_camera.x / CELL_SIZE; j < (g_camera.x + g_camera.w + CELL_SIZE) / CELL_SIZE && j < g_map.width; j++) {
-                if (g_map.matrix[i][j] == MAP_WALL) {
-                    SDL_Rect coords = {
-                        j * CELL_SIZE - g_camera.x,
-                        i * CELL_SIZE - g_camera.y,
-                        CELL_SIZE,
-                        CELL_SIZE
-                    };
-                    //TODO: compare SDL_RenderFillRect and SDL_FillRect speed
-                    SDL_RenderFillRect(g_renderer, &coords);
-                }
-                else if (g_map.matrix[i][j] == MAP_FOOD) {
-                    render_texture(g_leaf_texture, j * CELL_SIZE - g_camera.x, i * CELL_SIZE - g_camera.y);
-                }
-            }
-        }
-        //render anthill
-        render_texture(g_anthill_texture, anthill->x - g_camera.x, anthill->y - g_camera.y);
-
-        //draw HUD
-        //TODO: maybe draw a single picture (png) instead of many rects (also would be more pretty if drawn nice)
-        SDL_SetRenderDrawColor(g_renderer, 0x50, 0x50, 0x50, 0xFF);
-        SDL_Rect hud = {0, screen_height * 14 / 15, screen_width, screen_height / 15};
-        SDL_RenderFillRect(g_renderer, &hud);
-        SDL_SetRenderDrawColor(g_renderer, 0x90, 0xCC, 0x90, 0xFF);
-        SDL_Rect space_for_hud1 = {screen_width / 20, screen_height * 44 / 45 - g_food_count_texture.height / 2,
-            screen_width * 19/ 20, g_leaf_texture.height};
-        SDL_RenderFillRect(g_renderer, &space_for_hud1);
-        render_texture(g_leaf_texture, screen_width / 20, screen_height * 34 / 35 - g_leaf_texture.height / 2);
-        render_texture(g_food_count_texture, screen_width / 10, screen_height * 34 / 35 - g_food_count_texture.height / 2 - 5);
-
-        render_texture(g_anthill_icon_texture, screen_width * 4 / 5, screen_height * 34 / 35 - g_anthill_icon_texture.height / 2);
-        render_texture(g_anthill_level_texture, screen_width * 4 / 5 + g_anthill_icon_texture.width, screen_height * 34 / 35 - g_food_count_texture.height / 2 - 5);
-
-
-#if TUTORIAL
-        static int last_food_count;
-        if (g_tutorial != TUTORIAL_DONE) {
-            render_texture(g_tutorial_prompt, screen_width / 2 - g_tutorial_prompt.width / 2, 0);
-            switch (g_tutorial) {
-                case TUTORIAL_LEAVES:
-                    if (player->food_count >= 10) {
-                        g_tutorial++;
-                        SDL_DestroyTexture(g_tutorial_prompt.texture_proper);
-#if ANDROID_BUILD
-                        g_tutorial_prompt = load_text_texture("Enter your anthill and tap on it to upgrade");
-#else
-                        g_tutorial_prompt = load_text_texture("Enter your anthill and press Space to upgrade");
-#endif
-                    }
-                    break;
-                case TUTORIAL_UPGRADE:
-                    if (anthill->level > 0) {
-                        g_tutorial++;
-                        SDL_DestroyTexture(g_tutorial_prompt.texture_proper);
-                        g_tutorial_prompt = load_text_texture("Now reach level "STR(MAX_LEVEL)"!");
-                        last_food_count = player->food_count;
-                    };
-                    break;
-                case TUTORIAL_TEN:
-                    if (player->food_count > last_food_count) {
-                        g_tutorial++;
-                        SDL_DestroyTexture(g_tutorial_prompt.texture_proper);
-                        g_tutorial_prompt.texture_proper = NULL;
-                    }
-                    break;
-            }
-        }
-#endif
-        
+void cycle_time_scale(void) {
+    g_time_scale = (g_time_scale + 1) % TIME_SCALES_NUM;
+    g_sim_backlog = 0;
+    update_time_scale_text(g_time_scales[g_time_scale]);
 }
 
 void toggle_fullscreen(void) {
@@ -785,17 +244,13 @@ char *menu(void) {
         }
         SDL_RenderClear(g_renderer);
 
-        for (int y = 0; y < screen_height; y += g_background_texture.height) {
-            for (int x = 0; x < screen_width; x += g_background_texture.width) {
-                render_texture(g_background_texture, x, y);
-            }
-        }
+        render_background((SDL_Rect) {0, 0, screen_width, screen_height}, screen_width, screen_height);
 
         render_texture(choose_map_prompt, screen_width / 2 - choose_map_prompt.width / 2, 0);
         render_texture_scaled(map1thumb_texture, map1thumb.x, map1thumb.y, thumb_scale);
         render_texture_scaled(map2thumb_texture, map2thumb.x, map2thumb.y, thumb_scale);
 
-        SDL_RenderPresent(g_renderer);
+        present_frame();
     }
     SDL_DestroyTexture(choose_map_prompt.texture_proper);
     SDL_DestroyTexture(map1thumb_texture.texture_proper);
@@ -803,31 +258,39 @@ char *menu(void) {
     return map_path;
 }
 
-void destroy_npc(Npc *npc) {
-    SDL_RemoveTimer(npc->timer_id);
-    free(npc->ant);
-    free(npc);
-}
-
-void destroy_map(Map *map) {
-    for (size_t i = 0; i < map->height; i++) {
-        free(map->matrix[i]);
-    }
-    free(map->matrix);
-}
-
 //////////////// MAIN ///////////////////////////////////////////////////////////
 
 
 int main(int argc, char *argv[]) {
-    srand(time(NULL));
-    char *map_path;
+    //cants [--seed n] [--record replay] [--present vsync|uncapped|fps] [map]
+    char *map_path = NULL;
+    char *record_path = NULL;
+    uint64_t seed = time(NULL);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc) {
+            char *mode = argv[++i];
+            if (strcmp(mode, "vsync") == 0)
+                g_present_mode = PRESENT_VSYNC;
+            else if (strcmp(mode, "uncapped") == 0)
+                g_present_mode = PRESENT_UNCAPPED;
+            else if ((g_frame_limit = atoi(mode)) > 0)
+                g_present_mode = PRESENT_LIMITED;
+            else
+                SDL_Log("Warning: unknown present mode '%s', using vsync\n", mode);
+        }
+        else
+            map_path = argv[i];
+    }
+    sim_seed(seed);
+    SDL_Log("Seed %llu\n", (unsigned long long) seed);
     init();
     load_media();
 
-    if (argc > 1)
-        map_path = argv[1];
-    else {
+    if (map_path == NULL) {
         map_path = menu();
 
         if (map_path == NULL) {
@@ -853,8 +316,6 @@ int main(int argc, char *argv[]) {
     bool quit = false;
     bool reset = true;
 
-    g_eventstart = SDL_RegisterEvents(1);
-
     SDL_Event event;
 
     Player player = {0};
@@ -870,21 +331,27 @@ int main(int argc, char *argv[]) {
     player.width = g_ant_texture.width / ANT_FRAMES_NUM;
     player.height = g_ant_texture.height;
 
-    {
-        int universal_food_count = g_map.height * g_map.width / TILES_PER_FOOD;
-        while(g_world_food_count < universal_food_count) {
-            create_food();
-        }
+    if (!index_free_tiles() || !tile_layer_init() || !npc_grid_init(&g_npcs, g_map.width, g_map.height) ||
+        !pheromone_init(&g_pheromones, g_map.width, g_map.height) || !food_distance_init(&g_food_distance)) {
+        SDL_Log("Error: could not allocate the map indices\n");
+        exit(1);
+    }
+    seed_food(g_camera);
+    if (record_path != NULL && !replay_record(&g_recording, record_path, seed, map_path, g_camera)) {
+        SDL_Log("Warning: could not record the game to '%s'\n", record_path);
+        replay_finish(&g_recording, 0);
     }
 
-    //call move_player each ANT_MS_TO_MOVE sec
-    SDL_AddTimer(ANT_MS_TO_MOVE, move_player, (void *) &player);
+    g_sim_time = SDL_GetTicks();
 
     while (reset) {
         reset = false;
         while(!(quit || reset)) {
+            PROFILE_FRAME_BEGIN();
+            PROFILE_BEGIN(PROF_EVENTS);
             set_camera(&player);
             while(SDL_PollEvent(&event) != 0) {
+                int vel = player.vel, turn_vel = player.turn_vel;
                 switch (event.type) {
 #if ANDROID_BUILD
                     case SDL_FINGERDOWN:;
@@ -893,15 +360,10 @@ int main(int argc, char *argv[]) {
                         if (anthill.x <= x + g_camera.x && x + g_camera.x <= anthill.x + g_anthill_texture.width &&
                             anthill.y <= y + g_camera.y && y + g_camera.y <= anthill.y + g_anthill_texture.height) {
                             //tapped on the anthill
-                            if (player.in_anthill && player.food_count >= g_levels_table[anthill.level] && anthill.level < MAX_LEVEL) {
-                                player.food_count -= g_levels_table[anthill.level];
-                                update_food_count_texture(player.food_count, g_levels_table[anthill.level + 1]);
-
-                                for (int i = 0; i < g_levels_table[anthill.level] / 2; i++)
-                                    if (create_npc(anthill.gm_x, anthill.gm_y) == NULL)
-                                        SDL_Log("Warning: could not create NPC ant\n");
-
-                                update_anthill_level_texture(++anthill.level);
+                            if (player.in_anthill && upgrade_anthill(&player, &anthill)) {
+                                update_food_count_text(player.food_count, g_levels_table[anthill.level]);
+                                update_anthill_level_text(anthill.level);
+                                replay_write(&g_recording, (ReplayEvent) {.type = REPLAY_UPGRADE, .tick = g_sim_ticks});
                                 if (anthill.level == MAX_LEVEL) {
                                     goto win;
                                 }
@@ -940,23 +402,21 @@ int main(int argc, char *argv[]) {
 #if DEBUGMODE
                         //cheats for developers
                         case SDL_SCANCODE_LCTRL:
-                            if (create_npc(anthill.gm_x, anthill.gm_y) == NULL)
-                                SDL_Log("Warning: Could not allocate memory for an npc ant");
+                            queue_npcs(1);
+                            replay_write(&g_recording, (ReplayEvent) {.type = REPLAY_QUEUE_NPC, .tick = g_sim_ticks});
                             break;
                         case SDL_SCANCODE_RCTRL:
                             player.food_count++;
-                            update_food_count_texture(player.food_count, g_levels_table[anthill.level]);
+                            replay_write(&g_recording, (ReplayEvent) {.type = REPLAY_ADD_FOOD, .tick = g_sim_ticks});
+                            update_food_count_text(player.food_count, g_levels_table[anthill.level]);
                             break;
 #endif
                         case SDL_SCANCODE_SPACE:
-                            //upgrade if inside (TODO: copied to android btw which is a problem)
-                            if (player.in_anthill && player.food_count >= g_levels_table[anthill.level] && anthill.level < MAX_LEVEL) {
-                                player.food_count -= g_levels_table[anthill.level];
-                                update_food_count_texture(player.food_count, g_levels_table[anthill.level + 1]);
-                                for (int i = 0; i < g_levels_table[anthill.level] / 2; i++)
-                                    if (create_npc(anthill.gm_x, anthill.gm_y) == NULL)
-                                        SDL_Log("Warning: could not create NPC ant\n");
-                                update_anthill_level_texture(++anthill.level);
+                            //upgrade if inside
+                            if (player.in_anthill && upgrade_anthill(&player, &anthill)) {
+                                update_food_count_text(player.food_count, g_levels_table[anthill.level]);
+                                update_anthill_level_text(anthill.level);
+                                replay_write(&g_recording, (ReplayEvent) {.type = REPLAY_UPGRADE, .tick = g_sim_ticks});
                                 if (anthill.level == MAX_LEVEL) {
                                     goto win;
                                 }
@@ -965,6 +425,17 @@ int main(int argc, char *argv[]) {
                         case SDL_SCANCODE_F11:
                             toggle_fullscreen();
                             break;
+                        case SDL_SCANCODE_TAB:
+                            cycle_time_scale();
+                            break;
+#if PROFILER
+                        case SDL_SCANCODE_F3:
+                            profiler_toggle_overlay();
+                            break;
+                        case SDL_SCANCODE_F4:
+                            profiler_toggle_csv();
+                            break;
+#endif
                         case SDL_SCANCODE_ESCAPE:
                         case SDL_SCANCODE_AC_BACK:
                             reset = true;
@@ -1012,45 +483,57 @@ int main(int argc, char *argv[]) {
 #endif
                           }
                         break;
+                    case SDL_RENDER_TARGETS_RESET:
+                        tile_layer_invalidate();
+                        break;
                     case SDL_QUIT:
                         quit = true;
                         break;
-                    case SDL_USEREVENT:
-                        //only friendly ants currently
-                        player.food_count++;
-                        update_food_count_texture(player.food_count, g_levels_table[anthill.level]);
-                        create_food();
-                        break;
+                }
+                if (player.vel != vel || player.turn_vel != turn_vel) {
+                    replay_write(&g_recording, (ReplayEvent) {.type = REPLAY_STEER, .tick = g_sim_ticks,
+                        .vel = player.vel, .turn_vel = player.turn_vel});
                 }
             }
+            PROFILE_END();
+            PROFILE_BEGIN(PROF_SIM);
+            run_simulation(&player, &anthill);
+            apply_pickups(&player, &anthill);
+            PROFILE_END();
+            set_camera(&player);
             render_game_objects(&player, &anthill);
-            SDL_RenderPresent(g_renderer);
+            PROFILE_DRAW();
+            PROFILE_BEGIN(PROF_PRESENT);
+            present_frame();
+            PROFILE_END();
+            PROFILE_FRAME_END();
         }
+        //a recording ends with the map it was started on
+        replay_finish(&g_recording, g_sim_ticks);
 
         if (reset) {
             player.vel = 0;
             player.turn_vel = 0;
             if ((map_path = menu()) != NULL) {
-                for (size_t i = 0; i < g_npc_sp; i++) {
-                    destroy_npc(g_npc_stack[i]);
-                }
-                g_npc_sp = 0;
+                sim_reset();
                 destroy_map(&g_map);
-                load_map(map_path);
+                if (!load_map(map_path) || !index_free_tiles() || !tile_layer_init() ||
+                    !npc_grid_init(&g_npcs, g_map.width, g_map.height) ||
+                    !pheromone_init(&g_pheromones, g_map.width, g_map.height) || !food_distance_init(&g_food_distance)) {
+                    SDL_Log("Could not load map\n");
+                    exit(1);
+                }
                 level_width = g_map.width * CELL_SIZE;
                 level_height = g_map.height * CELL_SIZE;
                 init_anthill(&anthill);
-                player.ant->angle = 0;
-                player.ant->x = PLAYER_SPAWN_X;
-                player.ant->y = PLAYER_SPAWN_Y;
+                player.ant->angle = player.ant->prev_angle = 0;
+                player.ant->x = player.ant->prev_x = PLAYER_SPAWN_X;
+                player.ant->y = player.ant->prev_y = PLAYER_SPAWN_Y;
                 init_anthill(&anthill);
-                int universal_food_count = g_map.height * g_map.width / TILES_PER_FOOD;
-                g_world_food_count = 0;
-                while(g_world_food_count < universal_food_count) {
-                    create_food();
-                }
-
+                seed_food(g_camera);
             }
+            //the simulation was paused while in the menu
+            g_sim_time = SDL_GetTicks();
         }
     }
 
@@ -1058,6 +541,7 @@ int main(int argc, char *argv[]) {
 	return 0;
 
 win:;
+    replay_finish(&g_recording, g_sim_ticks);
     Texture win_texture = win();
     while(!quit) {
             while(SDL_PollEvent(&event) != 0) {
@@ -1078,41 +562,13 @@ win:;
                 }
             }
 
+        run_simulation(&player, &anthill);
+        //the game is won, leaves are no longer counted
+        pickup_queue_drain(&g_pickup_queue, NULL, 0, NULL);
         render_game_objects(&player, &anthill);
         render_texture(win_texture, screen_width / 2 - win_texture.width / 2, screen_height / 2 - win_texture.height / 2);
-        SDL_RenderPresent(g_renderer);
+        present_frame();
     }
     closesdl();
     return 0;
 }
-
-#define ANT_STACK_INIT_SIZE 10
-Npc** init_npc_stack(void) {
-    return malloc(ANT_STACK_INIT_SIZE * sizeof(Npc *));
-}
-
-bool push_npc(Npc *npc) {
-    static size_t stack_size = ANT_STACK_INIT_SIZE;
-    if (g_npc_sp < stack_size) {
-        g_npc_stack[g_npc_sp++] = npc;
-    }
-    else {
-        if ((g_npc_stack = realloc((void *) g_npc_stack, stack_size * 2 * sizeof(Ant *))) == NULL) {
-            return false;
-        }
-        stack_size *= 2;
-        g_npc_stack[g_npc_sp++] = npc;
-
-    }
-    return true;
-}
-
-bool check_collision(SDL_Rect a, SDL_Rect b) {
-    if(a.y + a.h <= b.y  ||
-        a.y >= b.y + b.h ||
-        a.x + a.w <= b.x ||
-        a.x >= b.x + b.w)
-        return false;
-    return true;
-}
-
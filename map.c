@@ -5,80 +5,762 @@
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
 #include "map.h"
 
+//a streamed map is read into its page file, mapping it would not help
+#if MAP_MMAP && !MAP_STREAMING
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 Map g_map = {0};
 
-bool load_map(char *path) {
+//the dirty bitmap with every chunk dirty, width and height have to be set
+static bool alloc_map_chunks(Map *map) {
+    size_t chunks = (size_t) MAP_CHUNKS_X(*map) * MAP_CHUNKS_Y(*map);
+    if ((map->dirty_chunks = malloc((chunks + 31) / 32 * sizeof(uint32_t))) == NULL) return false;
+    memset(map->dirty_chunks, 0xFF, (chunks + 31) / 32 * sizeof(uint32_t));
+    return true;
+}
 
-    SDL_RWops *map_file = SDL_RWFromFile(path, "rb");
-    if (map_file == NULL) return false;
+#if !MAP_STREAMING
+bool alloc_map(Map *map, int width, int height) {
+    size_t stride = (width + MAP_ALIGNMENT - 1) / MAP_ALIGNMENT * MAP_ALIGNMENT;
+    int8_t *tiles = SDL_SIMDAlloc(stride * height);
+    if (tiles == NULL) return false;
+    memset(tiles, MAP_FREE, stride * height);
+    map->tiles = tiles;
+    map->mapping = NULL;
+    map->mapping_size = 0;
+    map->stride = stride;
+    map->width = width;
+    map->height = height;
+    map->version = CANTS_MAP_VERSION;
+    map->encoding = MAP_ENCODING_RAW;
+    if (!alloc_map_chunks(map)) {
+        SDL_SIMDFree(tiles);
+        map->tiles = NULL;
+        return false;
+    }
+    return true;
+}
+
+#else
+//the page table and the resident slots of a map with no pages in memory yet,
+//the tiles are written to the page file while the map is loaded
+static bool alloc_paged_map(Map *map, int width, int height) {
+    map->width = width;
+    map->height = height;
+    map->pages_x = (width + MAP_PAGE_SIZE - 1) / MAP_PAGE_SIZE;
+    map->pages_y = (height + MAP_PAGE_SIZE - 1) / MAP_PAGE_SIZE;
+    map->resident_count = 0;
+    map->page_clock = 0;
+    map->page_slot = malloc((size_t) map->pages_x * map->pages_y * sizeof(int32_t));
+    map->resident = malloc(MAP_RESIDENT_PAGES * sizeof(MapPage));
+    map->page_file = tmpfile();
+    if (map->page_slot == NULL || map->resident == NULL || map->page_file == NULL || !alloc_map_chunks(map)) {
+        if (map->page_file == NULL) fprintf(stderr, "Could not create the page file: %s\n", strerror(errno));
+        destroy_map(map);
+        return false;
+    }
+    memset(map->page_slot, 0xFF, (size_t) map->pages_x * map->pages_y * sizeof(int32_t));
+    return true;
+}
+
+static void page_file_error(const char *action) {
+    fprintf(stderr, "Could not %s a page of the map: %s\n", action, strerror(errno));
+    exit(1);
+}
+
+MapPage *map_page_in(Map *map, int page) {
+    int slot;
+    if (map->resident_count < MAP_RESIDENT_PAGES) {
+        slot = map->resident_count++;
+    }
+    else {
+        slot = 0;
+        for (int i = 1; i < MAP_RESIDENT_PAGES; i++) {
+            if (map->resident[i].last_used < map->resident[slot].last_used) slot = i;
+        }
+        MapPage *victim = &map->resident[slot];
+        if (victim->dirty) {
+            if (fseek(map->page_file, (long) victim->page * MAP_PAGE_TILES, SEEK_SET) != 0 ||
+                fwrite(victim->tiles, 1, MAP_PAGE_TILES, map->page_file) != MAP_PAGE_TILES)
+                page_file_error("write back");
+        }
+        map->page_slot[victim->page] = -1;
+    }
+    MapPage *resident = &map->resident[slot];
+    if (fseek(map->page_file, (long) page * MAP_PAGE_TILES, SEEK_SET) != 0 ||
+        fread(resident->tiles, 1, MAP_PAGE_TILES, map->page_file) != MAP_PAGE_TILES)
+        page_file_error("read");
+    resident->page = page;
+    resident->dirty = false;
+    map->page_slot[page] = slot;
+    return resident;
+}
+#endif
 
-    //check the signature
-    {
-        char signature[sizeof CANTS_MAP_SIGNATURE / sizeof(char)] = {0};
-        if (SDL_RWread(map_file, &signature, sizeof(char), sizeof CANTS_MAP_SIGNATURE / sizeof(char) - 1) != sizeof CANTS_MAP_SIGNATURE / sizeof(char) - 1) {
+void destroy_map(Map *map) {
+#if MAP_STREAMING
+    free(map->page_slot);
+    free(map->resident);
+    if (map->page_file != NULL) fclose(map->page_file);
+    map->page_slot = NULL;
+    map->resident = NULL;
+    map->page_file = NULL;
+    map->resident_count = 0;
+#else
+#if MAP_MMAP
+    if (map->mapping != NULL) {
+        munmap(map->mapping, map->mapping_size);
+    }
+    else
+#endif
+    SDL_SIMDFree(map->tiles);
+    map->tiles = NULL;
+    map->mapping = NULL;
+    map->mapping_size = 0;
+    map->stride = 0;
+#endif
+    free(map->free_tiles);
+    free(map->free_slot);
+    free(map->dirty_chunks);
+    map->free_tiles = NULL;
+    map->free_slot = NULL;
+    map->free_count = 0;
+    map->dirty_chunks = NULL;
+    map->width = 0;
+    map->height = 0;
+}
+
+//everything after the signature up to the tiles
+static bool read_map_header(SDL_RWops *map_file, uint8_t *version, uint8_t *encoding, int *width, int *height) {
+    uint8_t first;
+    if (SDL_RWread(map_file, &first, sizeof first, 1) == 0) {
+        fprintf(stderr, "Failed reading from file.\n");
+        return false;
+    }
+    //v1: the first byte is the width
+    if (first != 0) {
+        uint8_t height_v1;
+        if (SDL_RWread(map_file, &height_v1, sizeof height_v1, 1) == 0) {
             fprintf(stderr, "Failed reading from file.\n");
             return false;
         }
-        if (strcmp(signature, CANTS_MAP_SIGNATURE) != 0) {
-            fprintf(stderr, "Given file is not a cants map.\n");
-            return false;
+        *version = 1;
+        *encoding = MAP_ENCODING_RAW;
+        *width = first;
+        *height = height_v1;
+        return true;
+    }
+
+    uint8_t fields[3];
+    Uint32 dimensions[2];
+    if (SDL_RWread(map_file, fields, sizeof fields, 1) == 0 ||
+        SDL_RWread(map_file, dimensions, sizeof dimensions, 1) == 0) {
+        fprintf(stderr, "Failed reading from file.\n");
+        return false;
+    }
+    *version = fields[0];
+    *encoding = fields[1];
+    if (*version != CANTS_MAP_VERSION) {
+        fprintf(stderr, "Unsupported map version %d.\n", *version);
+        return false;
+    }
+    if (*encoding >= MAP_ENCODINGS_NUM) {
+        fprintf(stderr, "Unsupported map encoding %d.\n", *encoding);
+        return false;
+    }
+    Uint32 w = SDL_SwapLE32(dimensions[0]), h = SDL_SwapLE32(dimensions[1]);
+    if (w == 0 || h == 0 || w > MAP_MAX_SIDE || h > MAP_MAX_SIDE) {
+        fprintf(stderr, "Invalid map size %ux%u.\n", (unsigned) w, (unsigned) h);
+        return false;
+    }
+    *width = w;
+    *height = h;
+    return true;
+}
+
+bool write_map_header(SDL_RWops *file, int width, int height, enum MAP_ENCODING encoding) {
+    uint8_t fields[4] = {0, CANTS_MAP_VERSION, encoding, 0};
+    Uint32 dimensions[2] = {SDL_SwapLE32((Uint32) width), SDL_SwapLE32((Uint32) height)};
+    return SDL_RWwrite(file, CANTS_MAP_SIGNATURE, sizeof(char), sizeof CANTS_MAP_SIGNATURE - 1) == sizeof CANTS_MAP_SIGNATURE - 1 &&
+           SDL_RWwrite(file, fields, sizeof fields, 1) == 1 &&
+           SDL_RWwrite(file, dimensions, sizeof dimensions, 1) == 1;
+}
+
+//the signature and the header
+static bool read_map_start(SDL_RWops *map_file, uint8_t *version, uint8_t *encoding, int *width, int *height) {
+    char signature[sizeof CANTS_MAP_SIGNATURE / sizeof(char)] = {0};
+    if (SDL_RWread(map_file, &signature, sizeof(char), sizeof CANTS_MAP_SIGNATURE / sizeof(char) - 1) != sizeof CANTS_MAP_SIGNATURE / sizeof(char) - 1) {
+        fprintf(stderr, "Failed reading from file.\n");
+        return false;
+    }
+    if (strcmp(signature, CANTS_MAP_SIGNATURE) != 0) {
+        fprintf(stderr, "Given file is not a cants map.\n");
+        return false;
+    }
+    return read_map_header(map_file, version, encoding, width, height);
+}
+
+//where the tiles are decoded to: rows of g_map or, when streaming, a band of MAP_PAGE_SIZE rows
+//that is cut into pages and appended to the page file once it is full
+typedef struct {
+#if MAP_STREAMING
+    int8_t *band;
+    int band_y;
+    bool ok;
+#else
+    int unused;
+#endif
+} RowSink;
+
+#if MAP_STREAMING
+static void flush_band(RowSink *sink) {
+    if (sink->band_y < 0) return;
+    size_t band_width = (size_t) g_map.pages_x * MAP_PAGE_SIZE;
+    int8_t page[MAP_PAGE_TILES];
+    for (int px = 0; px < g_map.pages_x; px++) {
+        for (int i = 0; i < MAP_PAGE_SIZE; i++) {
+            memcpy(&page[i * MAP_PAGE_SIZE], &sink->band[i * band_width + px * MAP_PAGE_SIZE], MAP_PAGE_SIZE);
         }
+        if (fwrite(page, 1, MAP_PAGE_TILES, g_map.page_file) != MAP_PAGE_TILES) sink->ok = false;
     }
+}
+#endif
+
+static bool sink_init(RowSink *sink) {
+#if MAP_STREAMING
+    sink->band = malloc((size_t) g_map.pages_x * MAP_PAGE_TILES);
+    sink->band_y = -1;
+    sink->ok = sink->band != NULL;
+    return sink->ok;
+#else
+    (void) sink;
+    return true;
+#endif
+}
 
-    //read width and height
-    if (SDL_RWread(map_file, &g_map.width, sizeof g_map.width, 1) == 0 ||
-    SDL_RWread(map_file, &g_map.height, sizeof g_map.height, 1) == 0) return false;
+//row y of the map, rows are asked for in order
+static int8_t *sink_row(RowSink *sink, int y) {
+#if MAP_STREAMING
+    size_t band_width = (size_t) g_map.pages_x * MAP_PAGE_SIZE;
+    if (y / MAP_PAGE_SIZE != sink->band_y) {
+        flush_band(sink);
+        sink->band_y = y / MAP_PAGE_SIZE;
+        //the parts of the last pages that are outside of the map are walls
+        memset(sink->band, MAP_WALL, band_width * MAP_PAGE_SIZE);
+    }
+    return &sink->band[(y % MAP_PAGE_SIZE) * band_width];
+#else
+    (void) sink;
+    return MAP_ROW(g_map, y);
+#endif
+}
 
-    if ((g_map.matrix = malloc(g_map.height * sizeof(int8_t *))) == NULL) return false;
+static bool sink_finish(RowSink *sink, bool ok) {
+#if MAP_STREAMING
+    if (ok) flush_band(sink);
+    free(sink->band);
+    if (ok && !sink->ok) fprintf(stderr, "Could not write the page file: %s\n", strerror(errno));
+    return ok && sink->ok && fflush(g_map.page_file) == 0;
+#else
+    (void) sink;
+    return ok;
+#endif
+}
+
+#if MAP_STREAMING
+static bool read_raw_tiles(SDL_RWops *map_file, RowSink *sink) {
     for (int i = 0; i < g_map.height; i++) {
-        if ((g_map.matrix[i] = malloc(g_map.width * sizeof(int8_t))) == NULL) {
-            //if failed, free everything allocated
-            for (int j = 0; j < i; j++) {
-                free(g_map.matrix[j]);
-            }
-            free(g_map.matrix);
-            g_map.matrix = NULL;
+        if (SDL_RWread(map_file, sink_row(sink, i), sizeof(int8_t), g_map.width) != (size_t) g_map.width) {
+            fprintf(stderr, "Failed reading from file.\n");
             return false;
         }
     }
+    return true;
+}
+#else
+//the file stores rows back to back, so read them all at once into the front of the buffer
+//and then spread them out to their strides starting from the last row
+static bool read_raw_tiles(SDL_RWops *map_file, RowSink *sink) {
+    (void) sink;
+    size_t size = (size_t) g_map.width * g_map.height;
+    if (SDL_RWread(map_file, g_map.tiles, sizeof(int8_t), size) != size) {
+        fprintf(stderr, "Failed reading from file.\n");
+        return false;
+    }
+    if (g_map.stride != (size_t) g_map.width) {
+        for (int i = g_map.height - 1; i > 0; i--) {
+            memmove(MAP_ROW(g_map, i), g_map.tiles + (size_t) i * g_map.width, g_map.width);
+            memset(MAP_ROW(g_map, i - 1) + g_map.width, MAP_FREE, g_map.stride - g_map.width);
+        }
+    }
+    return true;
+}
+#endif
+
+//encoded tiles go through a small buffer in both directions
+#define MAP_IO_BUFFER 4096
+
+typedef struct {
+    SDL_RWops *file;
+    uint8_t buf[MAP_IO_BUFFER];
+    size_t pos;
+    size_t len;
+} MapReader;
+
+static bool read_byte(MapReader *reader, uint8_t *byte) {
+    if (reader->pos == reader->len) {
+        reader->len = SDL_RWread(reader->file, reader->buf, 1, sizeof reader->buf);
+        reader->pos = 0;
+        if (reader->len == 0) return false;
+    }
+    *byte = reader->buf[reader->pos++];
+    return true;
+}
+
+//decode packed tiles straight into g_map
+static bool decode_packed(MapReader *reader, RowSink *sink) {
+    uint64_t bits = 0;
+    int bit_count = 0;
+    uint8_t byte;
     for (int i = 0; i < g_map.height; i++) {
-        if (SDL_RWread(map_file, g_map.matrix[i], sizeof(int8_t), g_map.width) == 0) {
-            for (int j = 0; j < g_map.height; j++) {
-                free(g_map.matrix[j]);
+        int8_t *row = sink_row(sink, i);
+        for (int j = 0; j < g_map.width; j++) {
+            if (bit_count < 3) {
+                //refill as much as fits, the last tiles may not need the whole word
+                while (bit_count <= 56 && read_byte(reader, &byte)) {
+                    bits |= (uint64_t) byte << bit_count;
+                    bit_count += 8;
+                }
+                if (bit_count < 3) {
+                    fprintf(stderr, "Failed reading from file.\n");
+                    return false;
+                }
             }
-            free(g_map.matrix);
-            g_map.matrix = NULL;
-            return false;
+            int8_t tile = bits & 7;
+            bits >>= 3;
+            bit_count -= 3;
+            if (tile >= MAP_TOTAL) {
+                fprintf(stderr, "The tiles of the map are corrupt.\n");
+                return false;
+            }
+            row[j] = tile;
         }
     }
+    return true;
+}
 
+//decode run length encoded tiles straight into g_map, a run is filled a row at a time
+static bool decode_rle(MapReader *reader, RowSink *sink) {
+    size_t left = (size_t) g_map.width * g_map.height;
+    int x = 0, y = 0;
+    uint8_t byte;
+    while (left > 0) {
+        uint8_t tile;
+        if (!read_byte(reader, &tile)) goto truncated;
+        //the length of a run never needs more than 5 LEB128 bytes
+        uint32_t length = 0;
+        int shift = 0;
+        do {
+            if (!read_byte(reader, &byte)) goto truncated;
+            if (shift > 28) goto corrupt;
+            //the 5th byte may only hold the top 4 bits of a 32 bit length
+            if (shift == 28 && (byte & 0x70)) goto corrupt;
+            length |= (uint32_t) (byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        //a run can not go past the last tile
+        if (tile >= MAP_TOTAL || length >= left) goto corrupt;
+        size_t run = (size_t) length + 1;
+        left -= run;
+        while (run > 0) {
+            int n = SDL_min(run, (size_t) (g_map.width - x));
+            memset(sink_row(sink, y) + x, tile, n);
+            run -= n;
+            x += n;
+            if (x == g_map.width) {
+                x = 0;
+                y++;
+            }
+        }
+    }
     return true;
+
+truncated:
+    fprintf(stderr, "Failed reading from file.\n");
+    return false;
+corrupt:
+    fprintf(stderr, "The tiles of the map are corrupt.\n");
+    return false;
 }
 
-Point find_random_free_spot_on_a_map(void) {
-    short x, y;
-    while (g_map.matrix[y = rand() % g_map.height][x = rand() % g_map.width] != MAP_FREE);
-    Point point = {x, y};
-    return point;
+#if !MAP_STREAMING
+typedef struct {
+    SDL_RWops *file;
+    uint8_t buf[MAP_IO_BUFFER];
+    size_t len;
+    bool ok;
+} MapWriter;
+
+static void flush_bytes(MapWriter *writer) {
+    if (writer->len > 0 && SDL_RWwrite(writer->file, writer->buf, 1, writer->len) != writer->len) {
+        writer->ok = false;
+    }
+    writer->len = 0;
+}
+
+static void write_byte(MapWriter *writer, uint8_t byte) {
+    if (writer->len == sizeof writer->buf) flush_bytes(writer);
+    writer->buf[writer->len++] = byte;
+}
+
+static void write_run(MapWriter *writer, int8_t tile, uint32_t run) {
+    write_byte(writer, tile);
+    uint32_t length = run - 1;
+    do {
+        uint8_t byte = length & 0x7F;
+        length >>= 7;
+        write_byte(writer, length != 0 ? byte | 0x80 : byte);
+    } while (length != 0);
 }
 
-//not the most efficient way, but allows to check if there are free points at all
-//TODO: index all free spaces and make this function extra fast and safe or find a better way to do this
-Point find_random_free_spot_on_a_map_safe(void) {
-    Point free_points[g_map.height * g_map.width];
-    int sp = 0;
-    Point point;
+bool write_map_tiles(SDL_RWops *file, const Map *map, enum MAP_ENCODING encoding) {
+    if (encoding == MAP_ENCODING_RAW) {
+        if (map->stride == (size_t) map->width) {
+            size_t size = (size_t) map->width * map->height;
+            return SDL_RWwrite(file, map->tiles, sizeof(int8_t), size) == size;
+        }
+        for (int i = 0; i < map->height; i++) {
+            if (SDL_RWwrite(file, MAP_ROW(*map, i), sizeof(int8_t), map->width) != (size_t) map->width) return false;
+        }
+        return true;
+    }
+
+    MapWriter writer = {.file = file, .ok = true};
+    uint32_t bits = 0;
+    int bit_count = 0;
+    int8_t tile = MAP_AT(*map, 0, 0);
+    uint32_t run = 0;
+    for (int i = 0; i < map->height; i++) {
+        const int8_t *row = MAP_ROW(*map, i);
+        for (int j = 0; j < map->width; j++) {
+            assert(row[j] >= 0 && row[j] < MAP_TOTAL);
+            if (encoding == MAP_ENCODING_PACKED) {
+                bits |= (uint32_t) row[j] << bit_count;
+                bit_count += 3;
+                if (bit_count >= 8) {
+                    write_byte(&writer, bits & 0xFF);
+                    bits >>= 8;
+                    bit_count -= 8;
+                }
+            }
+            else if (row[j] == tile) {
+                run++;
+            }
+            else {
+                write_run(&writer, tile, run);
+                tile = row[j];
+                run = 1;
+            }
+        }
+    }
+    if (encoding == MAP_ENCODING_PACKED && bit_count > 0) write_byte(&writer, bits);
+    if (encoding == MAP_ENCODING_RLE) write_run(&writer, tile, run);
+    flush_bytes(&writer);
+    return writer.ok;
+}
+#endif
+
+bool load_map_copy(char *path) {
+
+    SDL_RWops *map_file = SDL_RWFromFile(path, "rb");
+    if (map_file == NULL) return false;
+
+    uint8_t version, encoding;
+    int width, height;
+    if (!read_map_start(map_file, &version, &encoding, &width, &height)) {
+        SDL_RWclose(map_file);
+        return false;
+    }
+#if MAP_STREAMING
+    bool allocated = alloc_paged_map(&g_map, width, height);
+#else
+    bool allocated = alloc_map(&g_map, width, height);
+#endif
+    RowSink sink;
+    if (!allocated || !sink_init(&sink)) {
+        fprintf(stderr, "Could not allocate a %dx%d map.\n", width, height);
+        if (allocated) destroy_map(&g_map);
+        SDL_RWclose(map_file);
+        return false;
+    }
+    g_map.version = version;
+    g_map.encoding = encoding;
+
+    MapReader reader = {.file = map_file};
+    bool read;
+    if (encoding == MAP_ENCODING_PACKED) read = decode_packed(&reader, &sink);
+    else if (encoding == MAP_ENCODING_RLE) read = decode_rle(&reader, &sink);
+    else read = read_raw_tiles(map_file, &sink);
+    read = sink_finish(&sink, read);
+    SDL_RWclose(map_file);
+    if (!read) {
+        destroy_map(&g_map);
+        return false;
+    }
+    return true;
+}
+
+#if MAP_MMAP && !MAP_STREAMING
+enum MAPPED_LOAD { MAPPED_LOADED, MAPPED_FAILED, MAPPED_UNSUPPORTED };
+
+//map the whole file copy-on-write and use the raw tiles in place (rows are width bytes apart then),
+//MAPPED_UNSUPPORTED if the file can not be mapped (e.g. it is inside an apk) and has to be read
+static enum MAPPED_LOAD load_map_mapped(char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return MAPPED_UNSUPPORTED;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return MAPPED_UNSUPPORTED;
+    }
+    size_t file_size = st.st_size;
+    //private writable pages: leaves picked up and placed change the copy, never the file
+    void *mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return MAPPED_UNSUPPORTED;
+
+    //the header is parsed by the same code as for the files that are read
+    uint8_t version, encoding;
+    int width, height;
+    SDL_RWops *header = SDL_RWFromConstMem(mapping, SDL_min(file_size, MAP_HEADER_MAX_SIZE));
+    if (header == NULL) {
+        munmap(mapping, file_size);
+        return MAPPED_UNSUPPORTED;
+    }
+    bool read = read_map_start(header, &version, &encoding, &width, &height);
+    size_t offset = SDL_RWtell(header);
+    SDL_RWclose(header);
+    if (!read) {
+        munmap(mapping, file_size);
+        return MAPPED_FAILED;
+    }
+    if (encoding != MAP_ENCODING_RAW) {
+        munmap(mapping, file_size);
+        return MAPPED_UNSUPPORTED;
+    }
+    if (file_size - offset < (size_t) width * height) {
+        fprintf(stderr, "Failed reading from file.\n");
+        munmap(mapping, file_size);
+        return MAPPED_FAILED;
+    }
+
+    g_map.width = width;
+    g_map.height = height;
+    if (!alloc_map_chunks(&g_map)) {
+        munmap(mapping, file_size);
+        return MAPPED_FAILED;
+    }
+    g_map.mapping = mapping;
+    g_map.mapping_size = file_size;
+    g_map.tiles = (int8_t *) mapping + offset;
+    g_map.stride = width;
+    g_map.version = version;
+    g_map.encoding = encoding;
+    return MAPPED_LOADED;
+}
+#endif
+
+bool load_map(char *path) {
+#if MAP_MMAP && !MAP_STREAMING
+    enum MAPPED_LOAD loaded = load_map_mapped(path);
+    if (loaded != MAPPED_UNSUPPORTED) return loaded == MAPPED_LOADED;
+#endif
+    return load_map_copy(path);
+}
+
+#if MAP_STREAMING
+bool index_free_tiles(void) {
+    return true;
+}
+
+size_t map_sampled_area(void) {
+    return (size_t) g_map.resident_count * MAP_PAGE_TILES;
+}
+#else
+bool index_free_tiles(void) {
+    size_t size = (size_t) g_map.width * g_map.height;
+    free(g_map.free_tiles);
+    free(g_map.free_slot);
+    g_map.free_count = 0;
+    g_map.free_tiles = malloc(size * sizeof(int32_t));
+    g_map.free_slot = malloc(size * sizeof(int32_t));
+    if (g_map.free_tiles == NULL || g_map.free_slot == NULL) {
+        free(g_map.free_tiles);
+        free(g_map.free_slot);
+        g_map.free_tiles = NULL;
+        g_map.free_slot = NULL;
+        return false;
+    }
     for (int i = 0; i < g_map.height; i++) {
+        int8_t *row = MAP_ROW(g_map, i);
         for (int j = 0; j < g_map.width; j++) {
-            if (g_map.matrix[i][j] == MAP_FREE) {
-                point.y = i;
-                point.x = j;
-                free_points[sp++] = point;
+            int32_t tile = i * g_map.width + j;
+            if (row[j] == MAP_FREE) {
+                g_map.free_slot[tile] = g_map.free_count;
+                g_map.free_tiles[g_map.free_count++] = tile;
             }
+            else g_map.free_slot[tile] = -1;
         }
     }
-    assert(sp > 0);
-    return free_points[rand() % sp];
+    return true;
+}
+
+size_t map_sampled_area(void) {
+    return (size_t) g_map.width * g_map.height;
+}
+
+//swap two entries of the free tile list
+static void swap_free_slots(int a, int b) {
+    int32_t tile_a = g_map.free_tiles[a], tile_b = g_map.free_tiles[b];
+    g_map.free_tiles[a] = tile_b;
+    g_map.free_tiles[b] = tile_a;
+    g_map.free_slot[tile_b] = a;
+    g_map.free_slot[tile_a] = b;
+}
+#endif
+
+bool map_chunk_dirty(int cx, int cy) {
+    size_t chunk = (size_t) cy * MAP_CHUNKS_X(g_map) + cx;
+    return g_map.dirty_chunks[chunk / 32] & (1u << chunk % 32);
+}
+
+void clear_map_chunk_dirty(int cx, int cy) {
+    size_t chunk = (size_t) cy * MAP_CHUNKS_X(g_map) + cx;
+    g_map.dirty_chunks[chunk / 32] &= ~(1u << chunk % 32);
+}
+
+void mark_map_chunks_dirty(void) {
+    size_t chunks = (size_t) MAP_CHUNKS_X(g_map) * MAP_CHUNKS_Y(g_map);
+    memset(g_map.dirty_chunks, 0xFF, (chunks + 31) / 32 * sizeof(uint32_t));
+}
+
+void set_map_tile(int x, int y, int8_t tile) {
+    int8_t *cell = &MAP_TILE(x, y);
+    if (*cell != tile) {
+        size_t chunk = (size_t) (y / MAP_CHUNK_SIZE) * MAP_CHUNKS_X(g_map) + x / MAP_CHUNK_SIZE;
+        g_map.dirty_chunks[chunk / 32] |= 1u << chunk % 32;
+#if MAP_STREAMING
+        //the page was just accessed, so it is resident
+        g_map.resident[g_map.page_slot[(y / MAP_PAGE_SIZE) * g_map.pages_x + x / MAP_PAGE_SIZE]].dirty = true;
+#endif
+    }
+#if !MAP_STREAMING
+    if (g_map.free_slot != NULL && (*cell == MAP_FREE) != (tile == MAP_FREE)) {
+        int32_t index = y * g_map.width + x;
+        if (tile == MAP_FREE) {
+            g_map.free_slot[index] = g_map.free_count;
+            g_map.free_tiles[g_map.free_count++] = index;
+        }
+        else {
+            //swap-remove
+            swap_free_slots(g_map.free_slot[index], --g_map.free_count);
+            g_map.free_slot[index] = -1;
+        }
+    }
+#endif
+    *cell = tile;
+}
+
+#define FREE_SPOT_TRIES 8
+
+#if MAP_STREAMING
+//free tile of a resident page outside of the rect, sampled and then looked for in all resident pages
+//(the parts of pages outside of the map are walls, so they are never chosen)
+static bool resident_free_spot(Rng *rng, int x, int y, int w, int h, Point *point) {
+    if (g_map.resident_count == 0) return false;
+    for (int i = 0; i < FREE_SPOT_TRIES; i++) {
+        MapPage *page = &g_map.resident[rng_below(rng, g_map.resident_count)];
+        int tile = rng_below(rng, MAP_PAGE_TILES);
+        if (page->tiles[tile] != MAP_FREE) continue;
+        point->x = page->page % g_map.pages_x * MAP_PAGE_SIZE + tile % MAP_PAGE_SIZE;
+        point->y = page->page / g_map.pages_x * MAP_PAGE_SIZE + tile / MAP_PAGE_SIZE;
+        if (point->x < x || point->x >= x + w || point->y < y || point->y >= y + h) return true;
+    }
+
+    //every candidate replaces the chosen one with a probability of 1 / candidates seen so far
+    int seen = 0;
+    for (int i = 0; i < g_map.resident_count; i++) {
+        MapPage *page = &g_map.resident[i];
+        int page_x = page->page % g_map.pages_x * MAP_PAGE_SIZE, page_y = page->page / g_map.pages_x * MAP_PAGE_SIZE;
+        for (int tile = 0; tile < MAP_PAGE_TILES; tile++) {
+            if (page->tiles[tile] != MAP_FREE) continue;
+            int tx = page_x + tile % MAP_PAGE_SIZE, ty = page_y + tile / MAP_PAGE_SIZE;
+            if (tx >= x && tx < x + w && ty >= y && ty < y + h) continue;
+            if (rng_below(rng, ++seen) == 0) {
+                point->x = tx;
+                point->y = ty;
+            }
+        }
+    }
+    return seen > 0;
+}
+
+Point find_random_free_spot_on_a_map(Rng *rng) {
+    Point point = {0, 0};
+    bool found = resident_free_spot(rng, 0, 0, 0, 0, &point);
+    assert(found);
+    (void) found;
+    return point;
+}
+
+bool find_random_free_spot_outside(Rng *rng, int x, int y, int w, int h, Point *point) {
+    return resident_free_spot(rng, x, y, w, h, point);
+}
+#else
+
+static Point free_tile_point(int slot) {
+    Point point = {
+        g_map.free_tiles[slot] % g_map.width,
+        g_map.free_tiles[slot] / g_map.width
+    };
+    return point;
+}
+
+Point find_random_free_spot_on_a_map(Rng *rng) {
+    assert(g_map.free_count > 0);
+    return free_tile_point(rng_below(rng, g_map.free_count));
+}
+
+bool find_random_free_spot_outside(Rng *rng, int x, int y, int w, int h, Point *point) {
+    if (g_map.free_count == 0) return false;
+
+    //usually the rect covers a small part of the map and a few samples are enough
+    for (int i = 0; i < FREE_SPOT_TRIES; i++) {
+        *point = free_tile_point(rng_below(rng, g_map.free_count));
+        if (point->x < x || point->x >= x + w || point->y < y || point->y >= y + h) return true;
+    }
+
+    //otherwise move the free tiles inside the rect to the back of the list
+    //and choose from the ones left in front
+    int inside = 0;
+    for (int i = y < 0 ? 0 : y; i < y + h && i < g_map.height; i++) {
+        for (int j = x < 0 ? 0 : x; j < x + w && j < g_map.width; j++) {
+            int32_t slot = g_map.free_slot[i * g_map.width + j];
+            if (slot != -1) {
+                inside++;
+                swap_free_slots(slot, g_map.free_count - inside);
+            }
+        }
+    }
+    if (inside == g_map.free_count) return false;
+    *point = free_tile_point(rng_below(rng, g_map.free_count - inside));
+    return true;
 }
+#endif
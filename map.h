@@ -2,22 +2,151 @@
 #define MAP_H 1
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "rng.h"
 #include "cants_config.h"
 
+#if MAP_STREAMING
+#define MAP_PAGE_SIZE 64
+#define MAP_PAGE_TILES (MAP_PAGE_SIZE * MAP_PAGE_SIZE)
+//pages kept in memory (4 MiB of tiles)
+#ifndef MAP_RESIDENT_PAGES
+#define MAP_RESIDENT_PAGES 1024
+#endif
+
+//a MAP_PAGE_SIZE x MAP_PAGE_SIZE square of tiles that is in memory, row major
+typedef struct {
+    int8_t tiles[MAP_PAGE_TILES];
+    int32_t page;
+    uint64_t last_used;
+    bool dirty;
+} MapPage;
+#endif
+
+//without MAP_STREAMING tiles live in one contiguous buffer, rows are stride bytes apart
+//(stride is width rounded up to MAP_ALIGNMENT so that every row starts aligned)
+//free_tiles lists every MAP_FREE tile (as y * width + x) in no particular order,
+//free_slot maps a tile back to its position in free_tiles or -1 if the tile is not free
+//dirty_chunks has a bit per MAP_CHUNK_SIZE x MAP_CHUNK_SIZE chunk (row major), set_map_tile sets it
+//for the chunk of the changed tile so that whatever caches the chunk knows to rebuild it
+//version and encoding are those of the file the map was loaded from
+//if mapping is not NULL, the whole file is mapped copy-on-write and tiles point into it
+//(rows are then width bytes apart like in the file)
+//with MAP_STREAMING the map is split into pages (row major, pages_x per row) that are kept in page_file,
+//at most MAP_RESIDENT_PAGES of them are in memory, page_slot has the index into resident of every page or -1,
+//the least recently used page is written back (if it changed) and replaced when another one is needed
 typedef struct {
-    int8_t **matrix;
-    uint8_t width;
-    uint8_t height;
+#if MAP_STREAMING
+    int32_t *page_slot;
+    MapPage *resident;
+    int resident_count;
+    int pages_x;
+    int pages_y;
+    uint64_t page_clock;
+    FILE *page_file;
+#else
+    int8_t *tiles;
+    void *mapping;
+    size_t mapping_size;
+    size_t stride;
+#endif
+    int width;
+    int height;
+    uint8_t version;
+    uint8_t encoding;
+    int32_t *free_tiles;
+    int32_t *free_slot;
+    int free_count;
+    uint32_t *dirty_chunks;
 } Map;
 
 typedef struct {
-    short x;
-    short y;
+    int x;
+    int y;
 } Point;
 
+#define MAP_ALIGNMENT 32
+#define MAP_CHUNK_SIZE 8
+#define MAP_CHUNKS_X(map) (((map).width + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE)
+#define MAP_CHUNKS_Y(map) (((map).height + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE)
+
+#if MAP_STREAMING
+//bring a page into memory, evicting the least recently used one if all slots are taken
+MapPage *map_page_in(Map *map, int page);
+
+//the tile (x, y), valid until a tile of another page is accessed
+static inline int8_t *map_tile(Map *map, int x, int y) {
+    int page = (y / MAP_PAGE_SIZE) * map->pages_x + x / MAP_PAGE_SIZE;
+    int32_t slot = map->page_slot[page];
+    MapPage *resident = slot >= 0 ? &map->resident[slot] : map_page_in(map, page);
+    resident->last_used = ++map->page_clock;
+    return &resident->tiles[(y % MAP_PAGE_SIZE) * MAP_PAGE_SIZE + x % MAP_PAGE_SIZE];
+}
+
+//tile accessors (both are lvalues, but changes have to go through set_map_tile to be written back)
+#define MAP_AT(map, x, y) (*map_tile(&(map), x, y))
+#define MAP_TILE(x, y) MAP_AT(g_map, x, y)
+#else
+//tile accessors (both are lvalues)
+#define MAP_AT(map, x, y) ((map).tiles[(size_t) (y) * (map).stride + (x)])
+#define MAP_TILE(x, y) MAP_AT(g_map, x, y)
+//pointer to the first tile of a row
+#define MAP_ROW(map, y) (&(map).tiles[(size_t) (y) * (map).stride])
+#endif
+
+//A cants map file starts with CANTS_MAP_SIGNATURE, the rest depends on the version:
+//v1: uint8 width, uint8 height, then width * height tiles (int8, row by row)
+//v2: a zero byte (no v1 map is 0 tiles wide), uint8 version, uint8 encoding, uint8 reserved (0),
+//    uint32 width, uint32 height (little endian), then the tiles in the given encoding
+#define CANTS_MAP_VERSION 2
+//signature, marker, version, encoding, reserved, width, height
+#define MAP_HEADER_MAX_SIZE (sizeof CANTS_MAP_SIGNATURE - 1 + 4 + 2 * sizeof(uint32_t))
+//tile indices (y * width + x) have to fit into an int32_t
+#define MAP_MAX_SIDE 32768
+
+//tiles are stored row by row in every encoding, runs and bits go on across rows
+enum MAP_ENCODING {
+    MAP_ENCODING_RAW,       //an int8 per tile
+    MAP_ENCODING_PACKED,    //3 bits per tile, the first tile in the lowest bits of the first byte
+    MAP_ENCODING_RLE,       //runs: a byte with the tile, then the run length - 1 as unsigned LEB128
+    MAP_ENCODINGS_NUM
+};
+
 extern Map g_map;
+//loads both v1 and v2 maps, raw maps are mapped into memory where possible (see MAP_MMAP),
+//the other encodings are decoded while the file is read
+//(with MAP_STREAMING the tiles are decoded into the page file and nothing is resident at first)
 bool load_map(char *path);
-Point find_random_free_spot_on_a_map(void);
+//always read the tiles into memory owned by g_map,
+//for when the file is going to be overwritten while the map is loaded
+bool load_map_copy(char *path);
+//write the signature and a v2 header, the tiles are up to the caller
+bool write_map_header(SDL_RWops *file, int width, int height, enum MAP_ENCODING encoding);
+void destroy_map(Map *map);
+#if !MAP_STREAMING
+//write the tiles of a map in an encoding, goes after the header
+bool write_map_tiles(SDL_RWops *file, const Map *map, enum MAP_ENCODING encoding);
+//allocate a zeroed (MAP_FREE) map with every chunk dirty
+bool alloc_map(Map *map, int width, int height);
+#endif
+
+//build the free tile index of g_map (the editor works without one),
+//when streaming there is no index and free tiles are sampled from the resident pages
+bool index_free_tiles(void);
+//how many tiles the random free spots are chosen from: the whole map or the resident pages when streaming
+size_t map_sampled_area(void);
+//change a tile of g_map keeping the free tile index up to date
+void set_map_tile(int x, int y, int8_t tile);
+bool map_chunk_dirty(int cx, int cy);
+void clear_map_chunk_dirty(int cx, int cy);
+void mark_map_chunks_dirty(void);
+//O(1), the map must have at least one free tile, rng is the stream of the caller
+Point find_random_free_spot_on_a_map(Rng *rng);
+//random free tile outside of the rect (in tiles), false if there is none
+//takes a few samples and then O(rect area) at worst (O(resident tiles) when streaming)
+bool find_random_free_spot_outside(Rng *rng, int x, int y, int w, int h, Point *point);
 
 enum MAP { MAP_FREE, 
            MAP_WALL, 
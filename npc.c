@@ -0,0 +1,353 @@
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "npc.h"
+
+NpcPool g_npcs = {0};
+
+#define NPC_SLOT_NONE ((uint32_t) -1)
+//arrays start on this boundary so that they can be processed with aligned SIMD loads
+//and so that threads updating different ranges of npcs do not share cache lines (see sim_tick)
+#define NPC_ALIGNMENT 64
+
+//every per-npc array of the pool
+#define NPC_DENSE_ARRAYS(X) X(x) X(y) X(angle) X(prev_x) X(prev_y) X(prev_angle) X(frame) X(anim_time) \
+                            X(scale) X(state) X(target_angle) X(cw) X(steps_done) X(gm_x) X(gm_y) X(slot_of)
+#define NPC_SLOT_ARRAYS(X) X(dense_of) X(generation) X(grid_next) X(grid_prev) X(grid_bucket)
+#define NPC_ARRAYS(X) NPC_DENSE_ARRAYS(X) NPC_SLOT_ARRAYS(X)
+
+//lay the arrays out in block for the given capacity copying the old contents,
+//returns the size of the block (only computes it when block is NULL)
+static size_t npc_pool_layout(NpcPool *pool, char *block, size_t capacity) {
+    size_t offset = 0;
+#define NPC_LAYOUT(field)                                                                     \
+    if (block != NULL) {                                                                      \
+        if (pool->capacity > 0)                                                               \
+            memcpy(block + offset, pool->field, pool->capacity * sizeof *pool->field);        \
+        pool->field = (void *) (block + offset);                                              \
+    }                                                                                         \
+    offset += (capacity * sizeof *pool->field + NPC_ALIGNMENT - 1) / NPC_ALIGNMENT * NPC_ALIGNMENT;
+    NPC_ARRAYS(NPC_LAYOUT)
+#undef NPC_LAYOUT
+    return offset;
+}
+
+static bool npc_pool_grow(NpcPool *pool, size_t capacity) {
+    if (capacity >= 1u << NPC_SLOT_BITS) return false;
+    //SDL_SIMDAlloc only aligns to the SIMD registers, the arrays start on the next NPC_ALIGNMENT boundary
+    char *block = SDL_SIMDAlloc(npc_pool_layout(pool, NULL, capacity) + NPC_ALIGNMENT);
+    if (block == NULL) return false;
+    npc_pool_layout(pool, (char *) (((uintptr_t) block + NPC_ALIGNMENT - 1) & ~(uintptr_t) (NPC_ALIGNMENT - 1)), capacity);
+    SDL_SIMDFree(pool->block);
+    pool->block = block;
+
+    //new slots go to the free list
+    for (size_t i = pool->capacity; i < capacity; i++) {
+        pool->dense_of[i] = i + 1 < capacity ? i + 1 : pool->free_head;
+        pool->generation[i] = 0;
+        pool->grid_bucket[i] = -1;
+    }
+    if (capacity > pool->capacity)
+        pool->free_head = pool->capacity;
+    pool->capacity = capacity;
+    return true;
+}
+
+static void init_step_table(void);
+
+bool npc_pool_init(NpcPool *pool, size_t capacity) {
+    //set up here rather than by the first npc_advance, which may run on several threads at once
+    init_step_table();
+    memset(pool, 0, sizeof *pool);
+    pool->free_head = NPC_SLOT_NONE;
+    return npc_pool_grow(pool, capacity);
+}
+
+void npc_pool_destroy(NpcPool *pool) {
+    npc_grid_destroy(pool);
+    SDL_SIMDFree(pool->block);
+    memset(pool, 0, sizeof *pool);
+}
+
+void npc_pool_clear(NpcPool *pool) {
+    for (size_t i = 0; i < pool->count; i++) {
+        pool->generation[pool->slot_of[i]]++;
+        pool->grid_bucket[pool->slot_of[i]] = -1;
+    }
+    if (pool->grid_heads != NULL) {
+        for (int b = 0; b < pool->grid_width * pool->grid_height; b++) {
+            pool->grid_heads[b] = NPC_GRID_END;
+        }
+    }
+    for (size_t i = 0; i < pool->capacity; i++) {
+        pool->dense_of[i] = i + 1 < pool->capacity ? i + 1 : NPC_SLOT_NONE;
+    }
+    pool->free_head = pool->capacity > 0 ? 0 : NPC_SLOT_NONE;
+    pool->count = 0;
+}
+
+NpcHandle npc_alloc(NpcPool *pool) {
+    if (pool->free_head == NPC_SLOT_NONE && !npc_pool_grow(pool, pool->capacity ? pool->capacity * 2 : 16))
+        return NPC_NONE;
+    uint32_t slot = pool->free_head;
+    pool->free_head = pool->dense_of[slot];
+
+    size_t index = pool->count++;
+#define NPC_ZERO(field) memset(&pool->field[index], 0, sizeof *pool->field);
+    NPC_DENSE_ARRAYS(NPC_ZERO)
+#undef NPC_ZERO
+    pool->slot_of[index] = slot;
+    pool->dense_of[slot] = index;
+    return (NpcHandle) pool->generation[slot] << NPC_SLOT_BITS | slot;
+}
+
+long npc_index(const NpcPool *pool, NpcHandle handle) {
+    uint32_t slot = NPC_HANDLE_SLOT(handle);
+    if (handle == NPC_NONE || slot >= pool->capacity || pool->generation[slot] != handle >> NPC_SLOT_BITS)
+        return -1;
+    uint32_t index = pool->dense_of[slot];
+    if (index >= pool->count || pool->slot_of[index] != slot)
+        return -1;
+    return index;
+}
+
+NpcHandle npc_handle(const NpcPool *pool, size_t index) {
+    uint32_t slot = pool->slot_of[index];
+    return (NpcHandle) pool->generation[slot] << NPC_SLOT_BITS | slot;
+}
+
+static void grid_unlink(NpcPool *pool, uint32_t slot) {
+    int32_t bucket = pool->grid_bucket[slot];
+    if (bucket == -1) return;
+    uint32_t next = pool->grid_next[slot], prev = pool->grid_prev[slot];
+    if (prev != NPC_GRID_END) pool->grid_next[prev] = next;
+    else pool->grid_heads[bucket] = next;
+    if (next != NPC_GRID_END) pool->grid_prev[next] = prev;
+    pool->grid_bucket[slot] = -1;
+}
+
+static void grid_link(NpcPool *pool, uint32_t slot, int32_t bucket) {
+    uint32_t head = pool->grid_heads[bucket];
+    pool->grid_next[slot] = head;
+    pool->grid_prev[slot] = NPC_GRID_END;
+    if (head != NPC_GRID_END) pool->grid_prev[head] = slot;
+    pool->grid_heads[bucket] = slot;
+    pool->grid_bucket[slot] = bucket;
+}
+
+static int32_t grid_bucket_of(const NpcPool *pool, int gm_x, int gm_y) {
+    int bx = SDL_clamp(gm_x / NPC_GRID_CELLS, 0, pool->grid_width - 1);
+    int by = SDL_clamp(gm_y / NPC_GRID_CELLS, 0, pool->grid_height - 1);
+    return by * pool->grid_width + bx;
+}
+
+void npc_grid_destroy(NpcPool *pool) {
+    free(pool->grid_heads);
+    pool->grid_heads = NULL;
+    pool->grid_width = 0;
+    pool->grid_height = 0;
+}
+
+bool npc_grid_init(NpcPool *pool, int width, int height) {
+    npc_grid_destroy(pool);
+    int grid_width = (width + NPC_GRID_CELLS - 1) / NPC_GRID_CELLS;
+    int grid_height = (height + NPC_GRID_CELLS - 1) / NPC_GRID_CELLS;
+    if (grid_width <= 0 || grid_height <= 0 ||
+        (pool->grid_heads = malloc((size_t) grid_width * grid_height * sizeof(uint32_t))) == NULL)
+        return false;
+    pool->grid_width = grid_width;
+    pool->grid_height = grid_height;
+    for (int b = 0; b < grid_width * grid_height; b++) {
+        pool->grid_heads[b] = NPC_GRID_END;
+    }
+    for (size_t i = 0; i < pool->capacity; i++) {
+        pool->grid_bucket[i] = -1;
+    }
+    for (size_t i = 0; i < pool->count; i++) {
+        grid_link(pool, pool->slot_of[i], grid_bucket_of(pool, pool->gm_x[i], pool->gm_y[i]));
+    }
+    return true;
+}
+
+void npc_grid_update(NpcPool *pool, size_t i) {
+    if (pool->grid_heads == NULL) return;
+    uint32_t slot = pool->slot_of[i];
+    int32_t bucket = grid_bucket_of(pool, pool->gm_x[i], pool->gm_y[i]);
+    if (bucket == pool->grid_bucket[slot]) return;
+    grid_unlink(pool, slot);
+    grid_link(pool, slot, bucket);
+}
+
+NpcGridRange npc_grid_range(const NpcPool *pool, int x0, int y0, int x1, int y1) {
+    NpcGridRange range = {
+        SDL_max(x0, 0) / NPC_GRID_CELLS,
+        SDL_max(y0, 0) / NPC_GRID_CELLS,
+        SDL_min((x1 + NPC_GRID_CELLS - 1) / NPC_GRID_CELLS, pool->grid_width),
+        SDL_min((y1 + NPC_GRID_CELLS - 1) / NPC_GRID_CELLS, pool->grid_height)
+    };
+    return range;
+}
+
+size_t npc_grid_query_radius(const NpcPool *pool, float x, float y, float radius, int cell_size,
+                             NpcHandle *out, size_t max) {
+    size_t found = 0;
+    if (pool->grid_heads == NULL) return 0;
+    //an npc's gm cell is the one it is walking to, its position may still be a cell away
+    int x0 = floorf((x - radius) / cell_size) - 1, y0 = floorf((y - radius) / cell_size) - 1;
+    int x1 = floorf((x + radius) / cell_size) + 2, y1 = floorf((y + radius) / cell_size) + 2;
+    NpcGridRange range = npc_grid_range(pool, x0, y0, x1, y1);
+    for (int by = range.by0; by < range.by1; by++) {
+        for (int bx = range.bx0; bx < range.bx1; bx++) {
+            for (uint32_t slot = NPC_GRID_HEAD(pool, bx, by); slot != NPC_GRID_END; slot = pool->grid_next[slot]) {
+                uint32_t i = pool->dense_of[slot];
+                float dx = pool->x[i] - x, dy = pool->y[i] - y;
+                if (dx * dx + dy * dy <= radius * radius) {
+                    if (found < max) out[found] = npc_handle(pool, i);
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+void npc_free(NpcPool *pool, NpcHandle handle) {
+    long index = npc_index(pool, handle);
+    if (index == -1) return;
+    uint32_t slot = pool->slot_of[index];
+    grid_unlink(pool, slot);
+    size_t last = --pool->count;
+    if ((size_t) index != last) {
+#define NPC_MOVE(field) pool->field[index] = pool->field[last];
+        NPC_DENSE_ARRAYS(NPC_MOVE)
+#undef NPC_MOVE
+        pool->dense_of[pool->slot_of[index]] = index;
+    }
+    pool->generation[slot]++;
+    pool->dense_of[slot] = pool->free_head;
+    pool->free_head = slot;
+}
+
+//Per heading (angle / 45) deltas of a single step. The ants used to compute
+//cosf/sinf of their angle every step and multiply diagonal ones by M_SQRT2 in double,
+//so to produce exactly the same positions axis aligned steps are float additions
+//and diagonal ones are double additions rounded back to float.
+static float g_step_dx[8], g_step_dy[8];
+static double g_step_ddx[8], g_step_ddy[8];
+
+static void init_step_table(void) {
+    for (int i = 0; i < 8; i++) {
+        int angle = i * 45;
+        float rad = (angle - 90) * M_PI / 180.0;
+        g_step_dx[i] = cosf(rad);
+        g_step_dy[i] = sinf(rad);
+        g_step_ddx[i] = cosf(rad) * M_SQRT2;
+        g_step_ddy[i] = sinf(rad) * M_SQRT2;
+    }
+}
+
+#define emod(a, b) (((a) % (b)) + (b)) % (b)
+
+//everything but the position update of one npc, returns the heading if it steps or -1
+static inline int npc_advance_state(NpcPool *pool, size_t i, int step_len, int cell_size) {
+    switch (pool->state[i]) {
+        case ANT_STATE_TURN:
+            if (emod(pool->angle[i], 360) != pool->target_angle[i])
+                pool->angle[i] = emod(pool->angle[i] + 5 * pool->cw[i], 360);
+            else
+                pool->state[i] = ANT_STATE_STEP;
+            break;
+        case ANT_STATE_STEP:
+            if (pool->steps_done[i] < step_len) {
+                pool->steps_done[i]++;
+                //ants only step after turning to a target_angle, which is a multiple of 45
+                return pool->angle[i] / 45;
+            }
+            //correction
+            pool->x[i] = pool->gm_x[i] * cell_size + (float) cell_size / 2;
+            pool->y[i] = pool->gm_y[i] * cell_size + (float) cell_size / 2;
+            pool->state[i] = ANT_STATE_ARRIVE;
+            break;
+    }
+    return -1;
+}
+
+static inline void npc_advance_one(NpcPool *pool, size_t i, int step_len, int cell_size) {
+    int heading = npc_advance_state(pool, i, step_len, cell_size);
+    if (heading == -1) return;
+    if (heading % 2 == 0) {
+        pool->x[i] += g_step_dx[heading];
+        pool->y[i] += g_step_dy[heading];
+    }
+    else {
+        pool->x[i] += g_step_ddx[heading];
+        pool->y[i] += g_step_ddy[heading];
+    }
+}
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define NPC_LANES 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define NPC_LANES 4
+#endif
+
+#ifdef NPC_LANES
+//headings of a block of lanes are gathered by the scalar state pass,
+//then the positions of the whole block are updated at once
+static inline void npc_advance_block(NpcPool *pool, size_t i, int step_len, int cell_size) {
+    _Alignas(32) float dx[NPC_LANES], dy[NPC_LANES];
+    _Alignas(32) double ddx[NPC_LANES], ddy[NPC_LANES];
+    _Alignas(32) int32_t axis[NPC_LANES], diagonal[NPC_LANES];
+    for (int lane = 0; lane < NPC_LANES; lane++) {
+        int heading = npc_advance_state(pool, i + lane, step_len, cell_size);
+        bool steps = heading != -1;
+        if (!steps) heading = 0;
+        axis[lane] = steps && heading % 2 == 0 ? -1 : 0;
+        diagonal[lane] = steps && heading % 2 == 1 ? -1 : 0;
+        dx[lane] = g_step_dx[heading];
+        dy[lane] = g_step_dy[heading];
+        ddx[lane] = g_step_ddx[heading];
+        ddy[lane] = g_step_ddy[heading];
+    }
+    float *coords[2] = {pool->x + i, pool->y + i};
+    float *deltas[2] = {dx, dy};
+    double *double_deltas[2] = {ddx, ddy};
+    for (int c = 0; c < 2; c++) {
+#if defined(__AVX__)
+        __m256 v = _mm256_loadu_ps(coords[c]);
+        __m256 float_sum = _mm256_add_ps(v, _mm256_load_ps(deltas[c]));
+        __m128 lo = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), _mm256_load_pd(double_deltas[c])));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), _mm256_load_pd(double_deltas[c] + 4)));
+        __m256 double_sum = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+        v = _mm256_blendv_ps(v, float_sum, _mm256_load_ps((float *) axis));
+        v = _mm256_blendv_ps(v, double_sum, _mm256_load_ps((float *) diagonal));
+        _mm256_storeu_ps(coords[c], v);
+#else
+        __m128 v = _mm_loadu_ps(coords[c]);
+        __m128 float_sum = _mm_add_ps(v, _mm_load_ps(deltas[c]));
+        __m128 lo = _mm_cvtpd_ps(_mm_add_pd(_mm_cvtps_pd(v), _mm_load_pd(double_deltas[c])));
+        __m128 hi = _mm_cvtpd_ps(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), _mm_load_pd(double_deltas[c] + 2)));
+        __m128 double_sum = _mm_movelh_ps(lo, hi);
+        __m128 axis_mask = _mm_load_ps((float *) axis), diagonal_mask = _mm_load_ps((float *) diagonal);
+        __m128 kept = _mm_andnot_ps(_mm_or_ps(axis_mask, diagonal_mask), v);
+        v = _mm_or_ps(kept, _mm_or_ps(_mm_and_ps(axis_mask, float_sum), _mm_and_ps(diagonal_mask, double_sum)));
+        _mm_storeu_ps(coords[c], v);
+#endif
+    }
+}
+#endif
+
+void npc_advance(NpcPool *pool, size_t begin, size_t end, int step_len, int cell_size) {
+    size_t i = begin;
+#ifdef NPC_LANES
+    for (; i + NPC_LANES <= end; i += NPC_LANES) {
+        npc_advance_block(pool, i, step_len, cell_size);
+    }
+#endif
+    for (; i < end; i++) {
+        npc_advance_one(pool, i, step_len, cell_size);
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef NPC_H
+#define NPC_H 1
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//ANT_STATE_ARRIVE - the ant has just been put in the center of its target cell
+//and waits for the tile checks of the simulation
+enum ANT_STATES {ANT_STATE_PREPARE, ANT_STATE_TURN, ANT_STATE_STEP, ANT_STATE_ARRIVE};
+
+//Npc pool - state of every npc ant stored structure-of-arrays style.
+//Live npcs are packed in [0, count) of the dense arrays so that the per-tick update and
+//per-frame culling stream through memory. Removing an npc moves the last one into its place,
+//so dense indices are not stable - handles are. A handle is a slot in the slot table
+//(which points at the dense index) plus a generation that goes stale when the npc is freed.
+typedef uint32_t NpcHandle;
+#define NPC_SLOT_BITS 24
+#define NPC_HANDLE_SLOT(handle) ((handle) & ((1u << NPC_SLOT_BITS) - 1))
+#define NPC_NONE ((NpcHandle) -1)
+
+#define NPC_GRID_CELLS 8
+#define NPC_GRID_END ((uint32_t) -1)
+//first slot of a bucket, the rest follow through grid_next
+#define NPC_GRID_HEAD(pool, bx, by) ((pool)->grid_heads[(by) * (pool)->grid_width + (bx)])
+
+//buckets [bx0, bx1) x [by0, by1)
+typedef struct {
+    int bx0, by0;
+    int bx1, by1;
+} NpcGridRange;
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+
+    //dense arrays, indexed by [0, count)
+    float *x;
+    float *y;
+    int *angle;
+    float *prev_x; //x, y and angle before the last tick, frames are drawn in between
+    float *prev_y;
+    int *prev_angle;
+    int8_t *frame;
+    uint32_t *anim_time;
+    float *scale;
+    uint8_t *state;
+    int *target_angle;
+    int8_t *cw;
+    int *steps_done;
+    int *gm_x; //game coordinates
+    int *gm_y;
+    uint32_t *slot_of;
+
+    //slot table, indexed by slots [0, capacity)
+    uint32_t *dense_of; //dense index of a live slot or the next free slot
+    uint8_t *generation;
+    uint32_t *grid_next; //bucket list links (slots or NPC_GRID_END)
+    uint32_t *grid_prev;
+    int32_t *grid_bucket; //bucket the slot is linked into or -1
+    uint32_t free_head;
+
+    //spatial grid: every npc is linked into the bucket of NPC_GRID_CELLS x NPC_GRID_CELLS
+    //map cells that contains its gm_x, gm_y, NULL until npc_grid_init
+    uint32_t *grid_heads;
+    int grid_width;
+    int grid_height;
+
+    //every array lives in this single allocation
+    void *block;
+} NpcPool;
+
+extern NpcPool g_npcs;
+
+bool npc_pool_init(NpcPool *pool, size_t capacity);
+void npc_pool_destroy(NpcPool *pool);
+//free every npc at once, all the handles go stale
+void npc_pool_clear(NpcPool *pool);
+
+//O(1), the new npc is zeroed and lives at dense index pool->count - 1, NPC_NONE on failure
+NpcHandle npc_alloc(NpcPool *pool);
+//O(1), moves the last npc into the freed dense index
+void npc_free(NpcPool *pool, NpcHandle handle);
+//dense index of a live npc or -1 if the handle is stale
+long npc_index(const NpcPool *pool, NpcHandle handle);
+//handle of the npc at a dense index
+NpcHandle npc_handle(const NpcPool *pool, size_t index);
+
+//(re)build the grid for a map of width x height cells with the live npcs in it
+bool npc_grid_init(NpcPool *pool, int width, int height);
+void npc_grid_destroy(NpcPool *pool);
+//O(1), move the npc at dense index i to the bucket of its gm_x, gm_y if it has changed
+void npc_grid_update(NpcPool *pool, size_t i);
+//buckets that cover the cells [x0, x1) x [y0, y1), clamped to the grid
+NpcGridRange npc_grid_range(const NpcPool *pool, int x0, int y0, int x1, int y1);
+//handles of up to max npcs whose x, y lies within radius pixels of (x, y),
+//returns how many there are in total
+size_t npc_grid_query_radius(const NpcPool *pool, float x, float y, float radius, int cell_size,
+                             NpcHandle *out, size_t max);
+
+//advance the turning and stepping npcs in [begin, end) by one tick:
+//turning ones turn 5 degrees towards target_angle (or start stepping once they face it),
+//stepping ones move one pixel along their heading until step_len steps are done
+//and then snap to the center of their cell and become ANT_STATE_ARRIVE.
+//Other npcs are left alone. Uses SSE2/AVX when compiled with them.
+void npc_advance(NpcPool *pool, size_t begin, size_t end, int step_len, int cell_size);
+#endif //NPC_H
@@ -0,0 +1,91 @@
+#include <SDL2/SDL.h>
+#include <string.h>
+#include "cants_config.h"
+#include "pheromone.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+PheromoneField g_pheromones = {0};
+
+//rows are padded to a whole number of SIMD lanes
+#define PHEROMONE_LANES 4
+
+bool pheromone_init(PheromoneField *field, int width, int height) {
+    pheromone_destroy(field);
+#if MAP_STREAMING || FOOD_DISTANCE
+    (void) width;
+    (void) height;
+    return true;
+#else
+    size_t stride = ((size_t) width + 2 + PHEROMONE_LANES - 1) / PHEROMONE_LANES * PHEROMONE_LANES;
+    size_t size = stride * (height + 2) * sizeof(float);
+    field->levels = SDL_SIMDAlloc(size);
+    field->next = SDL_SIMDAlloc(size);
+    if (field->levels == NULL || field->next == NULL) {
+        pheromone_destroy(field);
+        return false;
+    }
+    memset(field->levels, 0, size);
+    memset(field->next, 0, size);
+    field->width = width;
+    field->height = height;
+    field->stride = stride;
+    return true;
+#endif
+}
+
+void pheromone_destroy(PheromoneField *field) {
+    SDL_SIMDFree(field->levels);
+    SDL_SIMDFree(field->next);
+    field->levels = NULL;
+    field->next = NULL;
+    field->width = 0;
+    field->height = 0;
+    field->stride = 0;
+}
+
+void pheromone_deposit(PheromoneField *field, int x, int y, float amount) {
+    field->levels[(size_t) (y + 1) * field->stride + x + 1] += amount;
+}
+
+//what is left of a tile's own scent and what it gets from each neighbour
+#define PHEROMONE_KEEP ((1 - PHEROMONE_EVAPORATION) * (1 - PHEROMONE_DIFFUSION))
+#define PHEROMONE_SPREAD ((1 - PHEROMONE_EVAPORATION) * PHEROMONE_DIFFUSION / 4)
+//fainter levels are cleared instead of fading through the denormals, which are slow to compute with
+#define PHEROMONE_FLOOR 1e-6f
+
+void pheromone_update_rows(PheromoneField *field, int begin, int end) {
+    size_t stride = field->stride;
+    for (int y = begin; y < end; y++) {
+        const float *row = field->levels + (size_t) (y + 1) * stride + 1;
+        float *out = field->next + (size_t) (y + 1) * stride + 1;
+        int x = 0;
+        //the vector and the scalar loop add up in the same order, so where the row is split does not matter
+#ifdef __SSE2__
+        __m128 keep = _mm_set1_ps(PHEROMONE_KEEP), spread = _mm_set1_ps(PHEROMONE_SPREAD);
+        __m128 faintest = _mm_set1_ps(PHEROMONE_FLOOR);
+        for (; x + PHEROMONE_LANES <= field->width; x += PHEROMONE_LANES) {
+            __m128 around = _mm_add_ps(_mm_loadu_ps(row + x - stride), _mm_loadu_ps(row + x + stride));
+            around = _mm_add_ps(around, _mm_loadu_ps(row + x + 1));
+            around = _mm_add_ps(around, _mm_loadu_ps(row + x - 1));
+            __m128 level = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(row + x), keep), _mm_mul_ps(around, spread));
+            _mm_storeu_ps(out + x, _mm_and_ps(level, _mm_cmpge_ps(level, faintest)));
+        }
+#endif
+        for (; x < field->width; x++) {
+            float around = row[x - stride] + row[x + stride];
+            around = around + row[x + 1];
+            around = around + row[x - 1];
+            float level = row[x] * PHEROMONE_KEEP + around * PHEROMONE_SPREAD;
+            out[x] = level >= PHEROMONE_FLOOR ? level : 0;
+        }
+    }
+}
+
+void pheromone_swap(PheromoneField *field) {
+    float *levels = field->levels;
+    field->levels = field->next;
+    field->next = levels;
+}
@@ -0,0 +1,50 @@
+#ifndef PHEROMONE_H
+#define PHEROMONE_H 1
+#include <stdbool.h>
+#include <stddef.h>
+
+//Pheromone field - a scent level per map tile. Npcs lay it where they pick up leaves
+//and every PHEROMONE_UPDATE_TICKS ticks it evaporates a bit and diffuses into the 4 neighbouring
+//tiles, so that it spreads out around the find and fades away. Npcs that don't see a leaf
+//go up its gradient (see sim.c). The update is vectorized with SSE2 when compiled with it
+//and split into bands of rows that can be updated by different threads.
+//Not used with MAP_STREAMING, the field of a map that big would not fit in memory,
+//nor with FOOD_DISTANCE, where npcs head for the nearest leaf instead (see food_distance.h).
+
+#define PHEROMONE_UPDATE_TICKS 10
+//per update
+#define PHEROMONE_EVAPORATION 0.05f
+//the share of a tile's scent that is spread evenly over its 4 neighbours per update
+#define PHEROMONE_DIFFUSION 0.4f
+//laid for every leaf picked up
+#define PHEROMONE_DEPOSIT 1.0f
+//anything fainter is not followed
+#define PHEROMONE_MIN_SCENT 0.001f
+
+typedef struct {
+    //(width + 2) x (height + 2) levels rows stride floats apart, with a border of tiles around
+    //the map that stays 0 so that the neighbours of any tile on the map can be read
+    float *levels;
+    float *next; //the update is written here and then the two are swapped
+    int width;
+    int height;
+    size_t stride;
+} PheromoneField;
+
+extern PheromoneField g_pheromones;
+
+//(re)build an empty field for a map of width x height tiles,
+//does nothing (levels stay NULL) with MAP_STREAMING or FOOD_DISTANCE
+bool pheromone_init(PheromoneField *field, int width, int height);
+void pheromone_destroy(PheromoneField *field);
+
+//x, y may be a tile off the map, the field must exist
+static inline float pheromone_at(const PheromoneField *field, int x, int y) {
+    return field->levels[(size_t) (y + 1) * field->stride + x + 1];
+}
+void pheromone_deposit(PheromoneField *field, int x, int y, float amount);
+//evaporate and diffuse the rows [begin, end) of the map into field->next,
+//every row has to be updated before pheromone_swap
+void pheromone_update_rows(PheromoneField *field, int begin, int end);
+void pheromone_swap(PheromoneField *field);
+#endif //PHEROMONE_H
@@ -0,0 +1,196 @@
+#include "profiler.h"
+
+#if PROFILER
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "map.h"
+#include "npc.h"
+#include "sim.h"
+#include "render.h"
+#include "text.h"
+
+//frames the averages and the worst frame are taken over
+#define PROFILER_HISTORY 120
+#define PROFILER_MAX_DEPTH 8
+//the overlay text is rebuilt that often so that it can be read
+#define PROFILER_TEXT_MS 500
+#define PROFILER_TEXT_SCALE 0.4
+//lines: the frame, one per phase, counters
+#define PROFILER_LINES (PROF_PHASES_NUM + 2)
+
+static const char *phase_names[PROF_PHASES_NUM] = {
+    "events",
+    "hud_text",
+    "sim",
+    "background",
+    "ants",
+    "tiles",
+    "hud",
+    "overlay",
+    "present",
+};
+
+typedef struct {
+    Uint64 frame_start;
+    //time of the last phase switch
+    Uint64 mark;
+    int stack[PROFILER_MAX_DEPTH];
+    int depth;
+    Uint64 phases[PROF_PHASES_NUM];
+    long counts[PROF_COUNTERS_NUM];
+
+    //finished frames, the last column is the whole frame
+    Uint64 history[PROFILER_HISTORY][PROF_PHASES_NUM + 1];
+    long history_counts[PROFILER_HISTORY][PROF_COUNTERS_NUM];
+    int history_pos;
+    int history_len;
+    long frame;
+
+    bool overlay;
+    FILE *csv;
+    Uint32 text_time;
+    char lines[PROFILER_LINES][128];
+} Profiler;
+
+static Profiler g_profiler;
+
+static double ticks_to_ms(Uint64 ticks) {
+    return (double) ticks * 1000 / SDL_GetPerformanceFrequency();
+}
+
+//give the time since the last switch to the innermost running phase
+static void profiler_charge(Uint64 now) {
+    if (g_profiler.depth > 0) {
+        g_profiler.phases[g_profiler.stack[g_profiler.depth - 1]] += now - g_profiler.mark;
+    }
+    g_profiler.mark = now;
+}
+
+void profiler_frame_begin(void) {
+    g_profiler.frame_start = g_profiler.mark = SDL_GetPerformanceCounter();
+    g_profiler.depth = 0;
+    memset(g_profiler.phases, 0, sizeof g_profiler.phases);
+    memset(g_profiler.counts, 0, sizeof g_profiler.counts);
+}
+
+void profiler_begin(enum PROFILER_PHASES phase) {
+    profiler_charge(SDL_GetPerformanceCounter());
+    if (g_profiler.depth < PROFILER_MAX_DEPTH) {
+        g_profiler.stack[g_profiler.depth] = phase;
+    }
+    g_profiler.depth++;
+}
+
+void profiler_end(void) {
+    profiler_charge(SDL_GetPerformanceCounter());
+    if (g_profiler.depth > 0) g_profiler.depth--;
+}
+
+void profiler_count(enum PROFILER_COUNTERS counter, int n) {
+    g_profiler.counts[counter] += n;
+}
+
+void profiler_frame_end(void) {
+    Uint64 total = SDL_GetPerformanceCounter() - g_profiler.frame_start;
+    Uint64 *row = g_profiler.history[g_profiler.history_pos];
+    for (int i = 0; i < PROF_PHASES_NUM; i++) {
+        row[i] = g_profiler.phases[i];
+    }
+    row[PROF_PHASES_NUM] = total;
+    memcpy(g_profiler.history_counts[g_profiler.history_pos], g_profiler.counts, sizeof g_profiler.counts);
+    g_profiler.history_pos = (g_profiler.history_pos + 1) % PROFILER_HISTORY;
+    if (g_profiler.history_len < PROFILER_HISTORY) g_profiler.history_len++;
+
+    if (g_profiler.csv != NULL) {
+        fprintf(g_profiler.csv, "%ld,%.4f", g_profiler.frame, ticks_to_ms(total));
+        for (int i = 0; i < PROF_PHASES_NUM; i++) {
+            fprintf(g_profiler.csv, ",%.4f", ticks_to_ms(g_profiler.phases[i]));
+        }
+        fprintf(g_profiler.csv, ",%zu,%ld,%d,%ld,%ld\n", g_npcs.count, g_profiler.counts[PROF_ANTS_DRAWN],
+                g_world_food_count, g_profiler.counts[PROF_LEAVES_DRAWN], g_profiler.counts[PROF_DRAW_CALLS]);
+    }
+    g_profiler.frame++;
+}
+
+void profiler_toggle_overlay(void) {
+    g_profiler.overlay = !g_profiler.overlay;
+    g_profiler.text_time = 0;
+}
+
+void profiler_toggle_csv(void) {
+    if (g_profiler.csv != NULL) {
+        fclose(g_profiler.csv);
+        g_profiler.csv = NULL;
+        SDL_Log("Stopped writing the frame trace to "PROFILER_CSV_PATH"\n");
+        return;
+    }
+    if ((g_profiler.csv = fopen(PROFILER_CSV_PATH, "w")) == NULL) {
+        SDL_Log("Warning: could not open "PROFILER_CSV_PATH" for writing\n");
+        return;
+    }
+    fprintf(g_profiler.csv, "frame,total_ms");
+    for (int i = 0; i < PROF_PHASES_NUM; i++) {
+        fprintf(g_profiler.csv, ",%s_ms", phase_names[i]);
+    }
+    fprintf(g_profiler.csv, ",ants,ants_drawn,leaves,leaves_drawn,draw_calls\n");
+    SDL_Log("Writing the frame trace to "PROFILER_CSV_PATH"\n");
+}
+
+//rebuild the overlay text from the history
+static void profiler_update_text(void) {
+    double average[PROF_PHASES_NUM + 1] = {0};
+    double worst[PROF_PHASES_NUM + 1] = {0};
+    for (int f = 0; f < g_profiler.history_len; f++) {
+        for (int i = 0; i <= PROF_PHASES_NUM; i++) {
+            double ms = ticks_to_ms(g_profiler.history[f][i]);
+            average[i] += ms / g_profiler.history_len;
+            if (ms > worst[i]) worst[i] = ms;
+        }
+    }
+    int last = (g_profiler.history_pos + PROFILER_HISTORY - 1) % PROFILER_HISTORY;
+    long *counts = g_profiler.history_counts[last];
+
+    for (int i = 0; i < PROFILER_LINES; i++) {
+        char *str = g_profiler.lines[i];
+        size_t size = sizeof g_profiler.lines[i];
+        if (i == 0)
+            snprintf(str, size, "frame %.2f ms avg, %.2f ms worst (%.0f fps)",
+                     average[PROF_PHASES_NUM], worst[PROF_PHASES_NUM],
+                     average[PROF_PHASES_NUM] > 0 ? 1000 / average[PROF_PHASES_NUM] : 0);
+        else if (i <= PROF_PHASES_NUM)
+            snprintf(str, size, "%s %.3f ms avg, %.3f ms worst", phase_names[i - 1], average[i - 1], worst[i - 1]);
+        else
+            snprintf(str, size, "ants %ld/%zu, leaves %ld/%d, draw calls %ld",
+                     counts[PROF_ANTS_DRAWN], g_npcs.count, counts[PROF_LEAVES_DRAWN], g_world_food_count,
+                     counts[PROF_DRAW_CALLS]);
+    }
+}
+
+void profiler_draw(void) {
+    if (!g_profiler.overlay) return;
+    profiler_begin(PROF_OVERLAY);
+    if (SDL_GetTicks() - g_profiler.text_time >= PROFILER_TEXT_MS || g_profiler.text_time == 0) {
+        profiler_update_text();
+        g_profiler.text_time = SDL_GetTicks();
+    }
+    //the overlay does not count towards the draw calls of the frame
+    long draw_calls = g_profiler.counts[PROF_DRAW_CALLS];
+    for (int i = 0; i < PROFILER_LINES; i++) {
+        render_text(g_profiler.lines[i], 0, i * text_height() * PROFILER_TEXT_SCALE, PROFILER_TEXT_SCALE);
+    }
+    g_profiler.counts[PROF_DRAW_CALLS] = draw_calls;
+    profiler_end();
+}
+
+void profiler_close(void) {
+    if (g_profiler.csv != NULL) {
+        fclose(g_profiler.csv);
+        g_profiler.csv = NULL;
+    }
+}
+
+#endif
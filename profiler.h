@@ -0,0 +1,66 @@
+#ifndef PROFILER_H
+#define PROFILER_H 1
+#include <SDL2/SDL.h>
+#include "cants_config.h"
+
+//Profiler - per-frame timings of the phases of the main loop measured with SDL_GetPerformanceCounter.
+//Phases nest: time spent in an inner phase is not counted in the outer one.
+//F3 toggles an overlay with rolling averages and worst frames, F4 starts/stops writing every frame
+//to PROFILER_CSV_PATH. Everything compiles out unless PROFILER is set (see cants_config.h).
+
+enum PROFILER_PHASES {
+    PROF_EVENTS,
+    PROF_HUD_TEXT,
+    PROF_SIM,
+    PROF_RENDER_BACKGROUND,
+    PROF_RENDER_ANTS,
+    PROF_RENDER_TILES,
+    PROF_RENDER_HUD,
+    PROF_OVERLAY,
+    PROF_PRESENT,
+    PROF_PHASES_NUM
+};
+
+enum PROFILER_COUNTERS {
+    PROF_ANTS_DRAWN,
+    PROF_LEAVES_DRAWN,
+    PROF_DRAW_CALLS,
+    PROF_COUNTERS_NUM
+};
+
+#define PROFILER_CSV_PATH "cants-profile.csv"
+
+#if PROFILER
+
+void profiler_frame_begin(void);
+void profiler_frame_end(void);
+void profiler_begin(enum PROFILER_PHASES phase);
+void profiler_end(void);
+void profiler_count(enum PROFILER_COUNTERS counter, int n);
+void profiler_toggle_overlay(void);
+void profiler_toggle_csv(void);
+//draw the overlay if it is enabled
+void profiler_draw(void);
+void profiler_close(void);
+
+#define PROFILE_FRAME_BEGIN() profiler_frame_begin()
+#define PROFILE_FRAME_END() profiler_frame_end()
+#define PROFILE_BEGIN(phase) profiler_begin(phase)
+#define PROFILE_END() profiler_end()
+#define PROFILE_COUNT(counter, n) profiler_count(counter, n)
+#define PROFILE_DRAW() profiler_draw()
+#define PROFILE_CLOSE() profiler_close()
+
+#else
+
+#define PROFILE_FRAME_BEGIN()
+#define PROFILE_FRAME_END()
+#define PROFILE_BEGIN(phase)
+#define PROFILE_END()
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_DRAW()
+#define PROFILE_CLOSE()
+
+#endif
+
+#endif
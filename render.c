@@ -0,0 +1,426 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "map.h"
+#include "npc.h"
+#include "sim.h"
+#include "render.h"
+#include "profiler.h"
+#include "text.h"
+#include "tile_layer.h"
+#include "batch.h"
+#include "workers.h"
+#include "cants_config.h"
+
+int screen_width = 1920;
+int screen_height = 1080;
+int level_width = 3000;
+int level_height = 3000;
+const Uint32 ANT_ANIM_MS = 100;
+
+#if TUTORIAL
+enum TUTORIAL_STAGES {TUTORIAL_LEAVES, TUTORIAL_UPGRADE, TUTORIAL_TEN, TUTORIAL_DONE};
+#endif
+
+//////////////// GLOBALS ////////////////////////////////////////////////////////
+
+SDL_Window* g_window;
+
+SDL_Renderer* g_renderer;
+
+Texture g_leaf_texture;
+Texture g_background_texture;
+Texture g_ant_texture;
+Texture g_anthill_texture;
+Texture g_anthill_icon_texture;
+Texture g_tutorial_prompt;
+
+//ants, leaves and background tiles are drawn in batches
+SpriteBatch g_ant_batch;
+SpriteBatch g_leaf_batch;
+static SpriteBatch g_background_batch;
+#define SPRITE_BATCH_INIT_CAPACITY 256
+//a 1080p screen needs 12 tiles of the 500x500 grass, the batch grows for bigger ones
+#define BACKGROUND_BATCH_INIT_CAPACITY 16
+
+//HUD strings, drawn from the glyph atlas
+char g_food_count_text[22] = "0/10";
+char g_anthill_level_text[22] = "1/"STR(MAX_LEVEL);
+//empty at normal speed
+char g_time_scale_text[8] = "";
+float g_render_alpha = 1;
+
+#if TUTORIAL
+enum TUTORIAL_STAGES g_tutorial = TUTORIAL_LEAVES;
+#endif
+TTF_Font *g_font;
+
+//Ant frames clip rects
+SDL_Rect g_antframes[ANT_FRAMES_NUM];
+
+SDL_Rect g_camera = {
+    0,
+    0,
+    0,
+    0
+};
+
+//////////////// FUNCTIONS //////////////////////////////////////////////////////
+
+//return Texture struct
+Texture load_texture(const char *path)
+{
+	//The final texture
+	SDL_Texture *new_texture = NULL;
+    SDL_Surface *loaded_surface = NULL;
+    Texture texture_struct = {0};
+
+	//Load image at specified path
+	imgcp((loaded_surface = IMG_Load(path)), "Could not load image");
+    //Create texture from surface pixels
+    scp((new_texture = SDL_CreateTextureFromSurface(g_renderer, loaded_surface)), "Could not create texture from surface");
+
+    texture_struct.texture_proper = new_texture;
+    texture_struct.width = loaded_surface->w;
+    texture_struct.height = loaded_surface->h;
+
+    //Get rid of old loaded surface
+    SDL_FreeSurface(loaded_surface);
+
+	return texture_struct;
+}
+
+Texture load_text_texture(const char *text){
+	SDL_Texture *new_texture = NULL;
+    SDL_Surface *text_surface = NULL;
+
+#define OUTLINE_SIZE 2
+    /* load font and its outline */
+    TTF_SetFontOutline(g_font, OUTLINE_SIZE);
+
+    /* render text and text outline */
+    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+    SDL_Color black = {0x00, 0x00, 0x00, 0xFF};
+    text_surface = TTF_RenderText_Blended(g_font, text, black);
+    SDL_Surface *fg_surface = TTF_RenderText_Blended(g_font, text, white);
+    SDL_Rect rect = {OUTLINE_SIZE, OUTLINE_SIZE, fg_surface->w, fg_surface->h};
+
+    /* blit text onto its outline */
+    SDL_SetSurfaceBlendMode(fg_surface, SDL_BLENDMODE_BLEND);
+    SDL_BlitSurface(fg_surface, NULL, text_surface, &rect);
+    SDL_FreeSurface(fg_surface);
+
+    scp((new_texture = SDL_CreateTextureFromSurface(g_renderer, text_surface)), "Could not create texture from surface");
+
+    const Texture texture_struct = {
+        new_texture,
+        text_surface->w,
+        text_surface->h
+
+    };
+    SDL_FreeSurface(text_surface);
+
+	return texture_struct;
+}
+
+void load_media() {
+    g_ant_texture = load_texture(ASSETS_PREFIX"antspritesheet.png");
+    for (int i = 0; i < ANT_FRAMES_NUM; i++) {
+        g_antframes[i].x = g_ant_texture.width * i / ANT_FRAMES_NUM;
+        g_antframes[i].y = 0;
+        g_antframes[i].h = g_ant_texture.height;
+        g_antframes[i].w = g_ant_texture.width / ANT_FRAMES_NUM;
+    }
+    g_background_texture = load_texture(ASSETS_PREFIX"grass500x500.png");
+    //"https://www.freepik.com/vectors/cartoon-grass" Cartoon grass vector created by babysofja - www.freepik.com
+    g_leaf_texture = load_texture(ASSETS_PREFIX"leaf.png");
+    if (!batch_init(&g_ant_batch, g_ant_texture, SPRITE_BATCH_INIT_CAPACITY) ||
+        !batch_init(&g_leaf_batch, g_leaf_texture, SPRITE_BATCH_INIT_CAPACITY) ||
+        !batch_init(&g_background_batch, g_background_texture, BACKGROUND_BATCH_INIT_CAPACITY)) {
+        SDL_Log("Error: Could not allocate sprite batches!");
+        exit(1);
+    }
+    ttfcp((g_font = TTF_OpenFont(ASSETS_PREFIX"OpenSans-Regular.ttf", 50)), "Could not open font");
+    if (!text_init(g_font)) {
+        exit(1);
+    }
+    assert(g_levels_table[0] == 10 && "wrong first level in a texture");
+    g_anthill_texture = load_texture(ASSETS_PREFIX"anthill.png");
+    g_anthill_icon_texture = load_texture(ASSETS_PREFIX"anthill_icon.png");
+    g_tutorial_prompt = load_text_texture("Use WASD to move around and collect leaves");
+}
+
+void closesdl()
+{
+    PROFILE_CLOSE();
+	//Free loaded image
+	SDL_DestroyTexture(g_ant_texture.texture_proper);
+    g_ant_texture.texture_proper = NULL;
+    SDL_DestroyTexture(g_background_texture.texture_proper);
+    g_background_texture.texture_proper = NULL;
+    SDL_DestroyTexture(g_leaf_texture.texture_proper);
+    g_background_texture.texture_proper = NULL;
+    SDL_DestroyTexture(g_anthill_texture.texture_proper);
+    g_background_texture.texture_proper = NULL;
+    SDL_DestroyTexture(g_anthill_icon_texture.texture_proper);
+    text_destroy();
+    tile_layer_destroy();
+    batch_destroy(&g_ant_batch);
+    batch_destroy(&g_leaf_batch);
+    batch_destroy(&g_background_batch);
+
+	SDL_DestroyRenderer(g_renderer);
+	SDL_DestroyWindow(g_window);
+	g_window = NULL;
+	g_renderer = NULL;
+
+    TTF_CloseFont(g_font);
+    workers_destroy();
+	//Quit SDL subsystems
+	IMG_Quit();
+    TTF_Quit();
+	SDL_Quit();
+}
+
+static float lerp(float from, float to) {
+    return from + (to - from) * g_render_alpha;
+}
+
+//the short way round
+static float lerp_angle(int from, int to) {
+    return from + (emod(to - from + 180, 360) - 180) * g_render_alpha;
+}
+
+void render_player_anim(Player *player) {
+    if (SDL_GetTicks() - player->ant->anim_time > ANT_ANIM_MS && (player->vel != 0 || player->turn_vel != 0)) {
+        player->ant->anim_time = SDL_GetTicks();
+        player->ant->frame = (player->ant->frame + 1) % ANT_FRAMES_NUM;
+    }
+    Ant *ant = player->ant;
+    SDL_FRect render_rect = {
+        .x = lerp(ant->prev_x, ant->x) - g_camera.x - g_ant_texture.width * ant->scale / ANT_FRAMES_NUM / 2,
+        .y = lerp(ant->prev_y, ant->y) - g_camera.y - g_ant_texture.height * ant->scale / 2,
+        .w = g_antframes[0].w * ant->scale,
+        .h = g_antframes[0].h * ant->scale,
+    };
+    batch_rotated_quad(&g_ant_batch, &g_antframes[ant->frame], render_rect, lerp_angle(ant->prev_angle, ant->angle));
+}
+
+//render the npc at dense index i of the npc pool
+void render_npc_anim(size_t i) {
+    NpcPool *npcs = &g_npcs;
+    if (SDL_GetTicks() - npcs->anim_time[i] > ANT_ANIM_MS) {
+        npcs->anim_time[i] = SDL_GetTicks();
+        npcs->frame[i] = (npcs->frame[i] + 1) % ANT_FRAMES_NUM;
+    }
+    SDL_FRect render_rect = {
+        .x = lerp(npcs->prev_x[i], npcs->x[i]) - g_camera.x - g_ant_texture.width * npcs->scale[i] / ANT_FRAMES_NUM / 2,
+        .y = lerp(npcs->prev_y[i], npcs->y[i]) - g_camera.y - g_ant_texture.height * npcs->scale[i] / 2,
+        .w = g_antframes[0].w * npcs->scale[i],
+        .h = g_antframes[0].h * npcs->scale[i],
+    };
+    batch_rotated_quad(&g_ant_batch, &g_antframes[npcs->frame[i]], render_rect,
+                       lerp_angle(npcs->prev_angle[i], npcs->angle[i]));
+}
+
+void render_texture(Texture texture, int x, int y) {
+    SDL_Rect render_rect;
+    render_rect.x = x;
+    render_rect.y = y;
+    render_rect.h = texture.height;
+    render_rect.w = texture.width;
+    SDL_RenderCopy(g_renderer, texture.texture_proper, NULL, &render_rect);
+    PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+}
+
+void render_texture_scaled(Texture texture, int x, int y, float scale) {
+    SDL_Rect render_rect;
+    render_rect.x = x;
+    render_rect.y = y;
+    render_rect.h = texture.height * scale;
+    render_rect.w = texture.width * scale;
+    SDL_RenderCopy(g_renderer, texture.texture_proper, NULL, &render_rect);
+    PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+}
+
+void set_camera(Player *player) {
+    //Center the camera over the player (where it is drawn)
+    g_camera.x = ((int) lerp(player->ant->prev_x, player->ant->x) + g_ant_texture.width / (2 * ANT_FRAMES_NUM)) - screen_width / 2;
+    g_camera.y = ((int) lerp(player->ant->prev_y, player->ant->y) + g_ant_texture.height / 2) - screen_height / 2;
+
+    //Keep the camera in bounds
+    if(g_camera.x < 0) {
+        g_camera.x = 0;
+    }
+    if(g_camera.y < 0) {
+        g_camera.y = 0;
+    }
+    if(g_camera.x > level_width - g_camera.w) {
+        g_camera.x = level_width - g_camera.w;
+    }
+    if(g_camera.y > level_height - g_camera.h) {
+        g_camera.y = level_height - g_camera.h;
+    }
+}
+
+void update_food_count_text(int food_count, int next_level) {
+    PROFILE_BEGIN(PROF_HUD_TEXT);
+    snprintf(g_food_count_text, sizeof g_food_count_text, "%d/%d", food_count, next_level);
+    PROFILE_END();
+}
+void update_anthill_level_text(int level) {
+    PROFILE_BEGIN(PROF_HUD_TEXT);
+    snprintf(g_anthill_level_text, sizeof g_anthill_level_text, "%d/%d", level, MAX_LEVEL);
+    PROFILE_END();
+}
+void update_time_scale_text(int scale) {
+    if (scale == 1)
+        g_time_scale_text[0] = '\0';
+    else if (scale == 0)
+        snprintf(g_time_scale_text, sizeof g_time_scale_text, "max");
+    else
+        snprintf(g_time_scale_text, sizeof g_time_scale_text, "x%d", scale);
+}
+
+void render_background(SDL_Rect view, int width, int height) {
+    int tile_w = g_background_texture.width;
+    int tile_h = g_background_texture.height;
+    //the range of tiles overlapping both the view and the tiled area,
+    //the last tile may stick out of the area like it always did
+    int x0 = SDL_max(view.x, 0) / tile_w;
+    int y0 = SDL_max(view.y, 0) / tile_h;
+    int x1 = (SDL_min(view.x + view.w, width) + tile_w - 1) / tile_w;
+    int y1 = (SDL_min(view.y + view.h, height) + tile_h - 1) / tile_h;
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            SDL_FRect coords = {
+                x * tile_w - view.x,
+                y * tile_h - view.y,
+                tile_w,
+                tile_h
+            };
+            batch_quad(&g_background_batch, NULL, coords);
+        }
+    }
+    batch_flush(&g_background_batch);
+}
+
+Texture win(void) {
+Texture win_texture = load_text_texture("Congratulations! You won!");
+return win_texture;
+}
+
+void render_game_objects(Player *player, Anthill *anthill) {
+        PROFILE_BEGIN(PROF_RENDER_BACKGROUND);
+        SDL_SetRenderDrawColor(g_renderer, 0x00, 0x90, 0x00, 0xFF);
+        SDL_RenderClear(g_renderer);
+
+        render_background(g_camera, level_width, level_height);
+
+        PROFILE_END();
+
+        PROFILE_BEGIN(PROF_RENDER_ANTS);
+        render_player_anim(player);
+
+        //render ants which are on the screen, only the grid buckets around the camera are visited
+        //(an ant is at most a cell away from its gm cell and smaller than a cell)
+        NpcGridRange range = npc_grid_range(&g_npcs,
+            g_camera.x / CELL_SIZE - 2, g_camera.y / CELL_SIZE - 2,
+            (g_camera.x + g_camera.w) / CELL_SIZE + 2, (g_camera.y + g_camera.h) / CELL_SIZE + 2);
+        for (int by = range.by0; by < range.by1; by++) {
+            for (int bx = range.bx0; bx < range.bx1; bx++) {
+                for (uint32_t slot = NPC_GRID_HEAD(&g_npcs, bx, by); slot != NPC_GRID_END; slot = g_npcs.grid_next[slot]) {
+                    size_t i = g_npcs.dense_of[slot];
+                    SDL_Rect coords = {
+                        g_npcs.x[i],
+                        g_npcs.y[i],
+                        g_ant_texture.width / ANT_FRAMES_NUM,
+                        g_ant_texture.height
+                    };
+                    if (check_collision(coords, g_camera)) {
+                        render_npc_anim(i);
+                        PROFILE_COUNT(PROF_ANTS_DRAWN, 1);
+                    }
+                }
+            }
+        }
+        batch_flush(&g_ant_batch);
+        PROFILE_END();
+
+        PROFILE_BEGIN(PROF_RENDER_TILES);
+        //walls and leaves
+        render_tile_layer();
+        PROFILE_END();
+
+        PROFILE_BEGIN(PROF_RENDER_HUD);
+        //render anthill
+        render_texture(g_anthill_texture, anthill->x - g_camera.x, anthill->y - g_camera.y);
+
+        //draw HUD
+        //TODO: maybe draw a single picture (png) instead of many rects (also would be more pretty if drawn nice)
+        SDL_SetRenderDrawColor(g_renderer, 0x50, 0x50, 0x50, 0xFF);
+        SDL_Rect hud = {0, screen_height * 14 / 15, screen_width, screen_height / 15};
+        SDL_RenderFillRect(g_renderer, &hud);
+        PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+        SDL_SetRenderDrawColor(g_renderer, 0x90, 0xCC, 0x90, 0xFF);
+        SDL_Rect space_for_hud1 = {screen_width / 20, screen_height * 44 / 45 - text_height() / 2,
+            screen_width * 19/ 20, g_leaf_texture.height};
+        SDL_RenderFillRect(g_renderer, &space_for_hud1);
+        PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+        render_texture(g_leaf_texture, screen_width / 20, screen_height * 34 / 35 - g_leaf_texture.height / 2);
+        render_text(g_food_count_text, screen_width / 10, screen_height * 34 / 35 - text_height() / 2 - 5, 1);
+
+        render_texture(g_anthill_icon_texture, screen_width * 4 / 5, screen_height * 34 / 35 - g_anthill_icon_texture.height / 2);
+        render_text(g_anthill_level_text, screen_width * 4 / 5 + g_anthill_icon_texture.width, screen_height * 34 / 35 - text_height() / 2 - 5, 1);
+        render_text(g_time_scale_text, screen_width / 2 - text_width(g_time_scale_text) / 2, screen_height * 34 / 35 - text_height() / 2 - 5, 1);
+
+
+#if TUTORIAL
+        static int last_food_count;
+        if (g_tutorial != TUTORIAL_DONE) {
+            render_texture(g_tutorial_prompt, screen_width / 2 - g_tutorial_prompt.width / 2, 0);
+            switch (g_tutorial) {
+                case TUTORIAL_LEAVES:
+                    if (player->food_count >= 10) {
+                        g_tutorial++;
+                        SDL_DestroyTexture(g_tutorial_prompt.texture_proper);
+#if ANDROID_BUILD
+                        g_tutorial_prompt = load_text_texture("Enter your anthill and tap on it to upgrade");
+#else
+                        g_tutorial_prompt = load_text_texture("Enter your anthill and press Space to upgrade");
+#endif
+                    }
+                    break;
+                case TUTORIAL_UPGRADE:
+                    if (anthill->level > 0) {
+                        g_tutorial++;
+                        SDL_DestroyTexture(g_tutorial_prompt.texture_proper);
+                        g_tutorial_prompt = load_text_texture("Now reach level "STR(MAX_LEVEL)"!");
+                        last_food_count = player->food_count;
+                    };
+                    break;
+                case TUTORIAL_TEN:
+                    if (player->food_count > last_food_count) {
+                        g_tutorial++;
+                        SDL_DestroyTexture(g_tutorial_prompt.texture_proper);
+                        g_tutorial_prompt.texture_proper = NULL;
+                    }
+                    break;
+            }
+        }
+#endif
+        PROFILE_END();
+}
+
+bool check_collision(SDL_Rect a, SDL_Rect b) {
+    if(a.y + a.h <= b.y  ||
+        a.y >= b.y + b.h ||
+        a.x + a.w <= b.x ||
+        a.x >= b.x + b.w)
+        return false;
+    return true;
+}
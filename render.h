@@ -0,0 +1,95 @@
+#ifndef RENDER_H
+#define RENDER_H 1
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdbool.h>
+#include "sim.h"
+
+//Rendering - textures, camera and drawing of the world and the HUD
+
+#define scp(pointer, message) {                                               \
+    if (pointer == NULL) {                                                    \
+        SDL_Log("Error: %s! SDL_Error: %s", message, SDL_GetError()); \
+        exit(1);                                                              \
+    }                                                                         \
+}
+
+#define scc(code, message) {                                                  \
+    if (code < 0) {                                                           \
+        SDL_Log("Error: %s! SDL_Error: %s", message, SDL_GetError()); \
+        exit(1);                                                              \
+    }                                                                         \
+}
+
+// turn an integer literal into a string literal
+#define STR_IMPL_(x) #x      //stringify argument
+#define STR(x) STR_IMPL_(x)  //indirection to expand argument macros
+
+#define imgcp(pointer, message) { if (pointer == NULL) {SDL_Log("Error: %s! IMG_Error: %s", message, IMG_GetError()); exit(1);}}
+#define imgcc(code, message) { if (code < 0) {SDL_Log("Error: %s! IMG_Error: %s", message, IMG_GetError()); exit(1);}}
+#define ttfcp(pointer, message) { if (pointer == NULL) {SDL_Log("Error: %s! TTF_Error: %s", message, TTF_GetError()); exit(1);}}
+#define ttfcc(code, message) { if (code < 0) {SDL_Log("Error: %s! TTF_Error: %s", message, TTF_GetError()); exit(1);}}
+
+extern int screen_width;
+extern int screen_height;
+extern int level_width;
+extern int level_height;
+extern const Uint32 ANT_ANIM_MS;
+
+//Texture - an SDL_Texture with additional information
+typedef struct {
+    SDL_Texture *texture_proper;
+    int width;
+    int height;
+} Texture;
+
+extern SDL_Window* g_window;
+extern SDL_Renderer* g_renderer;
+
+extern Texture g_leaf_texture;
+extern Texture g_background_texture;
+extern Texture g_ant_texture;
+extern Texture g_anthill_texture;
+extern Texture g_anthill_icon_texture;
+extern Texture g_tutorial_prompt;
+extern TTF_Font *g_font;
+
+//Ant frames clip rects
+#define ANT_FRAMES_NUM 4
+extern SDL_Rect g_antframes[ANT_FRAMES_NUM];
+
+extern SDL_Rect g_camera;
+//how far the frame is from the previous tick to the latest one (0 to 1),
+//ants and the camera are drawn interpolated between the two
+extern float g_render_alpha;
+
+//return Texture struct
+Texture load_texture(const char *path);
+Texture load_text_texture(const char *text);
+void load_media(void);
+void closesdl(void);
+
+//ants are queued into g_ant_batch, batch_flush draws them
+void render_player_anim(Player *player);
+//render the npc at dense index i of the npc pool
+void render_npc_anim(size_t i);
+void render_texture(Texture texture, int x, int y);
+void render_texture_scaled(Texture texture, int x, int y, float scale);
+void set_camera(Player *player);
+
+void update_food_count_text(int food_count, int next_level);
+void update_anthill_level_text(int level);
+//speed of the simulation shown in the HUD, 0 is as fast as possible
+void update_time_scale_text(int scale);
+//tile the background texture over the area from (0, 0) to (width, height),
+//only the tiles inside view are drawn (in one batch), view.x/y is the top left corner of the screen
+void render_background(SDL_Rect view, int width, int height);
+Texture win(void);
+//draw one frame of the game: background, ants, walls, leaves, anthill and HUD
+void render_game_objects(Player *player, Anthill *anthill);
+
+//check collision of two axis aligned rectangles
+bool check_collision(SDL_Rect x, SDL_Rect y);
+
+#endif
@@ -0,0 +1,168 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "replay.h"
+
+static void write_bytes(Replay *replay, const void *data, size_t size) {
+    if (replay->ok && SDL_RWwrite(replay->file, data, 1, size) != size) {
+        replay->ok = false;
+    }
+}
+
+static void write_i32(Replay *replay, int32_t value) {
+    Uint32 le = SDL_SwapLE32((Uint32) value);
+    write_bytes(replay, &le, sizeof le);
+}
+
+static void write_view(Replay *replay, SDL_Rect view) {
+    write_i32(replay, view.x);
+    write_i32(replay, view.y);
+    write_i32(replay, view.w);
+    write_i32(replay, view.h);
+}
+
+static bool read_bytes(Replay *replay, void *data, size_t size) {
+    return SDL_RWread(replay->file, data, 1, size) == size;
+}
+
+static bool read_i32(Replay *replay, int *value) {
+    Uint32 le;
+    if (!read_bytes(replay, &le, sizeof le)) return false;
+    *value = (int32_t) SDL_SwapLE32(le);
+    return true;
+}
+
+static bool read_view(Replay *replay, SDL_Rect *view) {
+    return read_i32(replay, &view->x) && read_i32(replay, &view->y) &&
+           read_i32(replay, &view->w) && read_i32(replay, &view->h);
+}
+
+bool replay_record(Replay *replay, const char *path, uint64_t seed, const char *map_path, SDL_Rect view) {
+    memset(replay, 0, sizeof *replay);
+    size_t path_length = strlen(map_path);
+    if (path_length >= REPLAY_MAX_PATH) {
+        fprintf(stderr, "Map path too long to be recorded.\n");
+        return false;
+    }
+    if ((replay->file = SDL_RWFromFile(path, "wb")) == NULL) {
+        fprintf(stderr, "Could not open '%s' for writing: %s\n", path, SDL_GetError());
+        return false;
+    }
+    replay->ok = true;
+    replay->seed = seed;
+    memcpy(replay->map_path, map_path, path_length + 1);
+    replay->view = view;
+
+    uint8_t version = REPLAY_VERSION;
+    Uint64 seed_le = SDL_SwapLE64(seed);
+    Uint16 length_le = SDL_SwapLE16((Uint16) path_length);
+    write_bytes(replay, REPLAY_SIGNATURE, sizeof REPLAY_SIGNATURE - 1);
+    write_bytes(replay, &version, sizeof version);
+    write_bytes(replay, &seed_le, sizeof seed_le);
+    write_bytes(replay, &length_le, sizeof length_le);
+    write_bytes(replay, map_path, path_length);
+    write_view(replay, view);
+    return replay->ok;
+}
+
+void replay_write(Replay *replay, ReplayEvent event) {
+    if (replay->file == NULL) return;
+    uint64_t delta = event.tick - replay->tick;
+    replay->tick = event.tick;
+    do {
+        uint8_t byte = delta & 0x7F;
+        delta >>= 7;
+        if (delta != 0) byte |= 0x80;
+        write_bytes(replay, &byte, 1);
+    } while (delta != 0);
+    write_bytes(replay, &event.type, 1);
+    switch (event.type) {
+        case REPLAY_STEER:;
+            int8_t steer[2] = {event.vel, event.turn_vel};
+            write_bytes(replay, steer, sizeof steer);
+            break;
+        case REPLAY_PICKUPS:
+            write_view(replay, event.view);
+            break;
+    }
+}
+
+bool replay_finish(Replay *replay, uint64_t tick) {
+    if (replay->file == NULL) return false;
+    replay_write(replay, (ReplayEvent) {.type = REPLAY_END, .tick = tick});
+    bool ok = replay->ok;
+    if (SDL_RWclose(replay->file) != 0) ok = false;
+    replay->file = NULL;
+    if (!ok) SDL_Log("Warning: the replay could not be written completely\n");
+    return ok;
+}
+
+bool replay_open(Replay *replay, const char *path) {
+    memset(replay, 0, sizeof *replay);
+    if ((replay->file = SDL_RWFromFile(path, "rb")) == NULL) {
+        fprintf(stderr, "Could not open '%s': %s\n", path, SDL_GetError());
+        return false;
+    }
+    char signature[sizeof REPLAY_SIGNATURE] = {0};
+    uint8_t version;
+    Uint64 seed_le;
+    Uint16 length_le;
+    if (!read_bytes(replay, signature, sizeof signature - 1) || strcmp(signature, REPLAY_SIGNATURE) != 0) {
+        fprintf(stderr, "Given file is not a cants replay.\n");
+        goto fail;
+    }
+    if (!read_bytes(replay, &version, sizeof version) || version != REPLAY_VERSION) {
+        fprintf(stderr, "Unsupported replay version.\n");
+        goto fail;
+    }
+    if (!read_bytes(replay, &seed_le, sizeof seed_le) || !read_bytes(replay, &length_le, sizeof length_le)) {
+        goto truncated;
+    }
+    replay->seed = SDL_SwapLE64(seed_le);
+    size_t path_length = SDL_SwapLE16(length_le);
+    if (path_length >= REPLAY_MAX_PATH || !read_bytes(replay, replay->map_path, path_length) ||
+        !read_view(replay, &replay->view)) {
+        goto truncated;
+    }
+    replay->map_path[path_length] = '\0';
+    return true;
+
+truncated:
+    fprintf(stderr, "The replay is truncated.\n");
+fail:
+    replay_close(replay);
+    return false;
+}
+
+bool replay_read(Replay *replay, ReplayEvent *event) {
+    memset(event, 0, sizeof *event);
+    uint64_t delta = 0;
+    uint8_t byte;
+    int shift = 0;
+    do {
+        if (shift > 63 || !read_bytes(replay, &byte, 1)) return false;
+        delta |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    if (!read_bytes(replay, &event->type, 1) || event->type >= REPLAY_EVENTS_NUM) return false;
+    replay->tick += delta;
+    event->tick = replay->tick;
+    switch (event->type) {
+        case REPLAY_STEER:;
+            int8_t steer[2];
+            if (!read_bytes(replay, steer, sizeof steer)) return false;
+            event->vel = steer[0];
+            event->turn_vel = steer[1];
+            break;
+        case REPLAY_PICKUPS:
+            if (!read_view(replay, &event->view)) return false;
+            break;
+    }
+    return true;
+}
+
+void replay_close(Replay *replay) {
+    if (replay->file != NULL) SDL_RWclose(replay->file);
+    replay->file = NULL;
+}
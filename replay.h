@@ -0,0 +1,61 @@
+#ifndef REPLAY_H
+#define REPLAY_H 1
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Replays - the seed, the map and the inputs of one game recorded so that cants-sim can run it again
+//without a window, as fast as possible. The simulation only depends on them (see sim_seed),
+//so the replay goes through exactly the same states as the game did.
+//
+//File format (little endian):
+//  "CANTSREC", version (u8), seed (u64), length of the map path (u16), map path,
+//  the view the first leaves were seeded around (4 x i32), then events:
+//  ticks since the previous event (LEB128), type (u8) and the fields of the type
+//  (REPLAY_STEER: vel, turn_vel as i8; REPLAY_PICKUPS: view as 4 x i32)
+
+#define REPLAY_SIGNATURE "CANTSREC"
+#define REPLAY_VERSION 1
+#define REPLAY_MAX_PATH 4096
+
+//what the main loop did to the simulation, not the SDL events themselves:
+//keys and touches that change the same thing are recorded the same way
+enum REPLAY_EVENTS {
+    REPLAY_STEER,       //the player's vel or turn_vel changed
+    REPLAY_UPGRADE,     //the anthill was upgraded
+    REPLAY_QUEUE_NPC,   //debug cheat: one more npc
+    REPLAY_ADD_FOOD,    //debug cheat: one more leaf for the player
+    REPLAY_PICKUPS,     //leaves picked up since the last frame were counted and respawned outside of view
+    REPLAY_END,         //the recording stopped
+    REPLAY_EVENTS_NUM
+};
+
+typedef struct {
+    uint8_t type;
+    uint64_t tick; //g_sim_ticks at the event, all the ticks before it have been run
+    int vel; //REPLAY_STEER
+    int turn_vel;
+    SDL_Rect view; //REPLAY_PICKUPS
+} ReplayEvent;
+
+typedef struct {
+    SDL_RWops *file;
+    bool ok; //no write has failed
+    uint64_t seed;
+    char map_path[REPLAY_MAX_PATH];
+    SDL_Rect view;
+    uint64_t tick; //of the last event
+} Replay;
+
+//create the file and write the start of the game to it
+bool replay_record(Replay *replay, const char *path, uint64_t seed, const char *map_path, SDL_Rect view);
+void replay_write(Replay *replay, ReplayEvent event);
+//write REPLAY_END at tick and close the file, false if anything could not be written
+bool replay_finish(Replay *replay, uint64_t tick);
+
+//read the start of a recorded game (seed, map_path and view)
+bool replay_open(Replay *replay, const char *path);
+//the next event in the order they were written, false at the end of the file or if it is corrupt
+bool replay_read(Replay *replay, ReplayEvent *event);
+void replay_close(Replay *replay);
+#endif //REPLAY_H
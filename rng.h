@@ -0,0 +1,41 @@
+#ifndef RNG_H
+#define RNG_H 1
+#include <stdint.h>
+
+//Random numbers - splitmix64 streams instead of the global rand().
+//Every user of random numbers has a stream of its own derived from the seed of the run,
+//so a run can be repeated from its seed and streams used by different threads share no state.
+
+typedef struct {
+    uint64_t state;
+} Rng;
+
+#define RNG_GOLDEN_GAMMA 0x9E3779B97F4A7C15ull
+
+static inline uint64_t rng_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+//stream number stream of the run seed, different streams give unrelated numbers
+static inline Rng rng_stream(uint64_t seed, uint64_t stream) {
+    Rng rng = {rng_mix(seed + rng_mix(stream + RNG_GOLDEN_GAMMA))};
+    return rng;
+}
+
+static inline uint64_t rng_next(Rng *rng) {
+    rng->state += RNG_GOLDEN_GAMMA;
+    return rng_mix(rng->state);
+}
+
+//[0, n), n > 0
+static inline uint32_t rng_below(Rng *rng, uint32_t n) {
+    return (uint32_t) (((rng_next(rng) >> 32) * n) >> 32);
+}
+
+//[0, 1)
+static inline float rng_float(Rng *rng) {
+    return (rng_next(rng) >> 40) * (1.0f / (1 << 24));
+}
+#endif //RNG_H
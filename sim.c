@@ -0,0 +1,526 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+#include "npc.h"
+#include "food_distance.h"
+#include "pheromone.h"
+#include "rng.h"
+#include "sim.h"
+#include "workers.h"
+#include "cants_config.h"
+
+const Uint32 ANT_MS_TO_MOVE = 10;
+const int ANT_VEL_MAX = 2;
+const int ANT_TURN_DEGREES = 1;
+const int CELL_SIZE = 50;
+const int ANT_STEP_LEN = CELL_SIZE;
+const int TILES_PER_FOOD = 90;
+//how many queued npcs leave the anthill per simulation tick
+const int NPC_SPAWNS_PER_TICK = 1;
+//fewer npcs than that are not worth waking up another worker for
+const int SIM_MIN_NPCS_PER_PART = 4096;
+//rows of the pheromone field per part of its update
+const int SIM_MIN_ROWS_PER_PART = 64;
+//how often an npc that sees no leaf goes up the pheromone gradient instead of wandering
+const int NPC_FOLLOW_SCENT_PERCENT = 80;
+
+//const int g_levels_table[MAX_LEVEL + 1] = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150, 160, 170, 180, 190, 200, 200};
+const int g_levels_table[MAX_LEVEL + 1] = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 100};
+
+int g_world_food_count;
+int g_npc_spawn_queue;
+uint64_t g_sim_ticks;
+uint64_t g_sim_seed;
+PickupQueue g_pickup_queue;
+
+//subsystem streams, see sim_seed
+enum SIM_STREAMS {SIM_STREAM_NPCS, SIM_STREAM_FOOD, SIM_STREAM_LOOKS};
+//npcs draw from a stream per slot and tick (npc_random) derived from this
+static uint64_t g_npc_seed;
+static Rng g_food_rng;
+//scale of the ants
+static Rng g_looks_rng;
+//running hash of the tiles create_food and remove_food changed, in order, for sim_state_hash
+static uint64_t g_leaf_hash;
+
+static void hash_leaf(int gm_x, int gm_y, bool added) {
+    g_leaf_hash = rng_mix(g_leaf_hash ^ ((uint64_t) gm_y << 33 | (uint64_t) gm_x << 1 | added));
+}
+
+//A tick updates the npcs in parts, one per worker (see workers.h). Parts only read the map
+//and write the npcs of their own dense range. What would touch anything shared - picking up
+//a leaf or moving to another grid bucket - is put in the outbox of the part instead
+//and done by sim_tick once every part is finished, in the order of the dense indices,
+//so the outcome does not depend on the number of threads.
+typedef struct {
+    uint32_t tile; //y * width + x
+    uint32_t index; //dense index of the npc
+} FoodClaim;
+
+typedef struct {
+    size_t begin, end;
+    size_t claims; //FoodClaims in g_claims[begin, begin + claims)
+    size_t moved; //dense indices of npcs that changed cells in g_moved[begin, begin + moved)
+} SimPart;
+
+//outboxes, a slot per npc
+static FoodClaim *g_claims;
+static uint32_t *g_moved;
+static size_t g_outbox_capacity;
+
+//remember the inverted y axis
+Point g_ant_move_table[8] = {
+    {0, -1}, //0
+    {1, -1}, //45
+    {1,  0}, //90
+    {1,  1}, //135
+    {0,  1}, //180
+    {-1, 1}, //225
+    {-1, 0}, //270
+    {-1,-1}  //315
+};
+
+Ant *create_ant(int x, int y) {
+    Ant *ant = malloc(sizeof(Ant));
+    if (ant == NULL) {
+        return NULL;
+    }
+    memset((void *) ant, 0, sizeof(Ant));
+    ant->anim_time = SDL_GetTicks();
+    ant->x = ant->prev_x = x;
+    ant->y = ant->prev_y = y;
+
+    ant->scale = rng_float(&g_looks_rng) + 0.75;
+    return ant;
+}
+
+bool pickup_queue_push(PickupQueue *queue, Pickup pickup) {
+    unsigned position = SDL_AtomicGet(&queue->head);
+    for (;;) {
+        SDL_atomic_t *sequence = &queue->sequence[position % PICKUP_QUEUE_SIZE];
+        unsigned lap = position - position % PICKUP_QUEUE_SIZE;
+        int ahead = (int) ((unsigned) SDL_AtomicGet(sequence) - lap);
+        if (ahead == 0) {
+            //the record is free, claim the position
+            if (SDL_AtomicCAS(&queue->head, position, position + 1)) {
+                queue->records[position % PICKUP_QUEUE_SIZE] = pickup;
+                SDL_AtomicSet(sequence, lap + 1);
+                return true;
+            }
+            position = SDL_AtomicGet(&queue->head);
+        }
+        else if (ahead < 0) {
+            //not drained yet since the last lap
+            SDL_AtomicAdd(&queue->dropped, 1);
+            return false;
+        }
+        else {
+            //another thread has pushed here in the meantime
+            position = SDL_AtomicGet(&queue->head);
+        }
+    }
+}
+
+int pickup_queue_drain(PickupQueue *queue, Pickup *out, int max, int *recorded) {
+    int count = 0, stored = 0;
+    for (;;) {
+        SDL_atomic_t *sequence = &queue->sequence[queue->tail % PICKUP_QUEUE_SIZE];
+        unsigned lap = queue->tail - queue->tail % PICKUP_QUEUE_SIZE;
+        if ((unsigned) SDL_AtomicGet(sequence) != lap + 1) break;
+        if (out != NULL && stored < max) out[stored++] = queue->records[queue->tail % PICKUP_QUEUE_SIZE];
+        SDL_AtomicSet(sequence, lap + PICKUP_QUEUE_SIZE);
+        queue->tail++;
+        count++;
+    }
+    if (recorded != NULL) *recorded = stored;
+    return count + SDL_AtomicSet(&queue->dropped, 0);
+}
+
+void remove_food(int gm_x, int gm_y, NpcHandle who) {
+    set_map_tile(gm_x, gm_y, MAP_FREE);
+    hash_leaf(gm_x, gm_y, false);
+    food_distance_remove(&g_food_distance, gm_x, gm_y);
+    pickup_queue_push(&g_pickup_queue, (Pickup) {who, gm_x, gm_y, g_sim_ticks});
+}
+
+bool create_food(SDL_Rect view) {
+    //tiles whose leaf (a cell sized picture) would overlap the view
+    int x0 = (int) floorf((float) (view.x - CELL_SIZE) / CELL_SIZE) + 1;
+    int y0 = (int) floorf((float) (view.y - CELL_SIZE) / CELL_SIZE) + 1;
+    int x1 = (view.x + view.w + CELL_SIZE - 1) / CELL_SIZE;
+    int y1 = (view.y + view.h + CELL_SIZE - 1) / CELL_SIZE;
+    Point point;
+    if (!find_random_free_spot_outside(&g_food_rng, x0, y0, x1 - x0, y1 - y0, &point)) {
+        SDL_Log("Warning: no free tile for a leaf\n");
+        return false;
+    }
+
+    set_map_tile(point.x, point.y, MAP_FOOD);
+    hash_leaf(point.x, point.y, true);
+    food_distance_add(&g_food_distance, point.x, point.y);
+    g_world_food_count++;
+    return true;
+}
+
+void seed_food(SDL_Rect view) {
+    int universal_food_count = map_sampled_area() / TILES_PER_FOOD;
+    //one search from all the leaves is cheaper than updating the distances leaf by leaf
+    g_food_distance.deferred = true;
+    while (g_world_food_count < universal_food_count && create_food(view));
+    food_distance_rebuild(&g_food_distance);
+}
+
+void move_player(Player *player) {
+    if (player->vel >= 0)
+        player->ant->angle += player->turn_vel;
+    else
+        player->ant->angle -= player->turn_vel;
+
+    if (player->vel != 0) {
+                                        //convert angle to radians
+        float dx = cosf((player->ant->angle - 90) * M_PI / 180.0);
+        float dy = sinf((player->ant->angle - 90) * M_PI / 180.0);
+        player->ant->x += player->vel * dx;
+        player->ant->y += player->vel * dy;
+        //collision checks
+        //TODO: accessing the map with the player outside of the map may segfault
+        //Circular collision might be worth it
+        int gm_x = (int) player->ant->x / CELL_SIZE, gm_y = (int) player->ant->y / CELL_SIZE;
+        switch (MAP_TILE(gm_x, gm_y)) {
+            case MAP_FREE:
+                player->in_anthill = false;
+                break;
+            case MAP_ANTHILL:
+                player->in_anthill = true;
+                /* FALLTHRU */
+            case MAP_WALL:
+                player->ant->x -= player->vel * dx;
+                player->ant->y -= player->vel * dy;
+                break;
+            case MAP_FOOD:
+                remove_food(gm_x, gm_y, NPC_NONE);
+                break;
+        }
+    }
+}
+
+//the draw'th number in [0, n) of an npc slot in this tick: every npc has a stream of its own
+//that does not depend on the order the npcs are updated in, so it may be used from any thread
+static int npc_random(uint32_t slot, uint32_t draw, int n) {
+    Rng rng = rng_stream(g_npc_seed + g_sim_ticks, (uint64_t) draw << 32 | slot);
+    return rng_below(&rng, n);
+}
+
+static bool passable(int gm_x, int gm_y) {
+    return MAP_TILE(gm_x, gm_y) != MAP_WALL && MAP_TILE(gm_x, gm_y) != MAP_ANTHILL;
+}
+
+//the direction of the neighbouring cell closest to a leaf, -1 if no leaf can be reached
+static int follow_food_distance(size_t i) {
+    int gm_x = g_npcs.gm_x[i], gm_y = g_npcs.gm_y[i];
+    int32_t nearest = food_distance_at(&g_food_distance, gm_x, gm_y);
+    int direction = -1;
+    for (int j = 0; j < 8; j++) {
+        int32_t distance = food_distance_at(&g_food_distance, gm_x + g_ant_move_table[j].x, gm_y + g_ant_move_table[j].y);
+        if (distance < nearest) {
+            nearest = distance;
+            direction = j;
+        }
+    }
+    return direction;
+}
+
+//the direction of the neighbouring cell with the strongest scent if it is stronger
+//than the one of the cell the npc is on, -1 if there is none
+static int follow_scent(size_t i) {
+    int gm_x = g_npcs.gm_x[i], gm_y = g_npcs.gm_y[i];
+    float strongest = pheromone_at(&g_pheromones, gm_x, gm_y);
+    if (strongest < PHEROMONE_MIN_SCENT) strongest = PHEROMONE_MIN_SCENT;
+    int direction = -1;
+    for (int j = 0; j < 8; j++) {
+        int x = gm_x + g_ant_move_table[j].x, y = gm_y + g_ant_move_table[j].y;
+        float scent = pheromone_at(&g_pheromones, x, y);
+        if (scent > strongest && passable(x, y)) {
+            strongest = scent;
+            direction = j;
+        }
+    }
+    return direction;
+}
+
+//the part of the npc update that looks at the map: choosing the next cell and picking up leaves
+//(turning and stepping is done for all npcs at once by npc_advance)
+static void move_npc(size_t i, SimPart *part) {
+    NpcPool *npcs = &g_npcs;
+    switch (npcs->state[i]) {
+        case ANT_STATE_PREPARE:;
+
+            Point target_cell = {-1, -1};
+
+            for (int j = 0; j < 8; j++) {
+                int gm_x = npcs->gm_x[i] + g_ant_move_table[j].x;
+                int gm_y = npcs->gm_y[i] + g_ant_move_table[j].y;
+                if (MAP_TILE(gm_x, gm_y) == MAP_FOOD) {
+                    target_cell.x = gm_x;
+                    target_cell.y = gm_y;
+                    npcs->target_angle[i] = j * 45;
+                }
+            }
+            if (target_cell.x == -1 && g_food_distance.distances != NULL) {
+                int n = follow_food_distance(i);
+                if (n != -1) {
+                    npcs->target_angle[i] = n * 45;
+                    target_cell.x = npcs->gm_x[i] + g_ant_move_table[n].x;
+                    target_cell.y = npcs->gm_y[i] + g_ant_move_table[n].y;
+                }
+            }
+            uint32_t draw = 0;
+            if (target_cell.x == -1 && g_pheromones.levels != NULL &&
+                    npc_random(npcs->slot_of[i], draw++, 100) < NPC_FOLLOW_SCENT_PERCENT) {
+                int n = follow_scent(i);
+                if (n != -1) {
+                    npcs->target_angle[i] = n * 45;
+                    target_cell.x = npcs->gm_x[i] + g_ant_move_table[n].x;
+                    target_cell.y = npcs->gm_y[i] + g_ant_move_table[n].y;
+                }
+            }
+            if (target_cell.x == -1) {
+                //no leaf and no scent, choose random cell
+                do {
+                int n = npc_random(npcs->slot_of[i], draw++, 8);
+                Point random_offset = g_ant_move_table[n];
+                npcs->target_angle[i] = n * 45;
+                target_cell.x = npcs->gm_x[i] + random_offset.x;
+                target_cell.y = npcs->gm_y[i] + random_offset.y;
+                } 
+                while (!passable(target_cell.x, target_cell.y));
+            }
+            npcs->gm_x[i] = target_cell.x;
+            npcs->gm_y[i] = target_cell.y;
+            g_moved[part->begin + part->moved++] = i;
+            npcs->steps_done[i] = 0;
+
+            if ((npcs->angle[i] > npcs->target_angle[i] && npcs->angle[i] - npcs->target_angle[i] > 180) ||
+                    (npcs->target_angle[i] > npcs->angle[i] && npcs->target_angle[i] - npcs->angle[i] < 180)) npcs->cw[i] = 1;
+            else npcs->cw[i] = -1;
+
+            npcs->state[i] = ANT_STATE_TURN;
+
+            //TODO: may segfault on boundary of the map
+            break;
+
+        case ANT_STATE_ARRIVE:
+            if (MAP_TILE(npcs->gm_x[i], npcs->gm_y[i]) == MAP_FOOD) {
+                g_claims[part->begin + part->claims++] = (FoodClaim) {
+                    (uint32_t) npcs->gm_y[i] * g_map.width + npcs->gm_x[i], i};
+            }
+            npcs->state[i] = ANT_STATE_PREPARE;
+            break;
+    }
+}
+
+NpcHandle create_npc(int gm_x, int gm_y) {
+    NpcHandle handle = npc_alloc(&g_npcs);
+    if (handle == NPC_NONE) return NPC_NONE;
+    size_t i = g_npcs.count - 1;
+    g_npcs.anim_time[i] = SDL_GetTicks();
+    g_npcs.x[i] = g_npcs.prev_x[i] = (gm_x + 0.5) * CELL_SIZE;
+    g_npcs.y[i] = g_npcs.prev_y[i] = (gm_y + 0.5) * CELL_SIZE;
+    g_npcs.scale[i] = rng_float(&g_looks_rng) + 0.75;
+    g_npcs.gm_x[i] = gm_x;
+    g_npcs.gm_y[i] = gm_y;
+    npc_grid_update(&g_npcs, i);
+    g_npcs.state[i] = ANT_STATE_PREPARE;
+#if DEBUGMODE
+    SDL_Log("Ant #%zu created at x %d y %d\n", i, (int) g_npcs.x[i], (int) g_npcs.y[i]);
+#endif
+    return handle;
+}
+
+void queue_npcs(int count) {
+    g_npc_spawn_queue += count;
+}
+
+static void run_part(void *data, int p, int parts) {
+    (void) parts;
+    SimPart *part = (SimPart *) data + p;
+    part->claims = part->moved = 0;
+    size_t count = part->end - part->begin;
+    memcpy(g_npcs.prev_x + part->begin, g_npcs.x + part->begin, count * sizeof *g_npcs.x);
+    memcpy(g_npcs.prev_y + part->begin, g_npcs.y + part->begin, count * sizeof *g_npcs.y);
+    memcpy(g_npcs.prev_angle + part->begin, g_npcs.angle + part->begin, count * sizeof *g_npcs.angle);
+    npc_advance(&g_npcs, part->begin, part->end, ANT_STEP_LEN, CELL_SIZE);
+    for (size_t i = part->begin; i < part->end; i++) {
+        move_npc(i, part);
+    }
+}
+
+static int compare_claims(const void *a, const void *b) {
+    const FoodClaim *x = a, *y = b;
+    if (x->tile != y->tile) return (x->tile > y->tile) - (x->tile < y->tile);
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static void grow_outboxes(size_t count) {
+    if (count <= g_outbox_capacity) return;
+    size_t capacity = g_outbox_capacity ? g_outbox_capacity : 64;
+    while (capacity < count) capacity *= 2;
+    FoodClaim *claims = realloc(g_claims, capacity * sizeof *claims);
+    if (claims != NULL) g_claims = claims;
+    uint32_t *moved = realloc(g_moved, capacity * sizeof *moved);
+    if (moved != NULL) g_moved = moved;
+    if (claims == NULL || moved == NULL) {
+        SDL_Log("Error: could not allocate memory for the simulation outboxes\n");
+        exit(1);
+    }
+    g_outbox_capacity = capacity;
+}
+
+//the tick boundary: the outboxes of the parts are applied in order
+static void resolve_parts(SimPart *parts, int count) {
+    size_t claims = 0;
+    for (int p = 0; p < count; p++) {
+        for (size_t m = 0; m < parts[p].moved; m++) {
+            npc_grid_update(&g_npcs, g_moved[parts[p].begin + m]);
+        }
+        memmove(g_claims + claims, g_claims + parts[p].begin, parts[p].claims * sizeof *g_claims);
+        claims += parts[p].claims;
+    }
+    //ants that arrive at the same leaf in one tick: the first one in dense order gets it
+    qsort(g_claims, claims, sizeof *g_claims, compare_claims);
+    for (size_t c = 0; c < claims; c++) {
+        if (c > 0 && g_claims[c].tile == g_claims[c - 1].tile) continue;
+        int gm_x = g_claims[c].tile % g_map.width, gm_y = g_claims[c].tile / g_map.width;
+        remove_food(gm_x, gm_y, npc_handle(&g_npcs, g_claims[c].index));
+        if (g_pheromones.levels != NULL) pheromone_deposit(&g_pheromones, gm_x, gm_y, PHEROMONE_DEPOSIT);
+    }
+}
+
+static void update_pheromone_part(void *data, int p, int parts) {
+    PheromoneField *field = data;
+    int rows = (field->height + parts - 1) / parts;
+    int begin = p * rows, end = begin + rows;
+    pheromone_update_rows(field, begin < field->height ? begin : field->height,
+                          end < field->height ? end : field->height);
+}
+
+static void update_pheromones(void) {
+    int parts_count = workers_count();
+    if (parts_count > g_pheromones.height / SIM_MIN_ROWS_PER_PART) parts_count = g_pheromones.height / SIM_MIN_ROWS_PER_PART;
+    if (parts_count < 1) parts_count = 1;
+    workers_run(update_pheromone_part, &g_pheromones, parts_count);
+    pheromone_swap(&g_pheromones);
+}
+
+void sim_tick(Player *player, Anthill *anthill) {
+    for (int i = 0; i < NPC_SPAWNS_PER_TICK && g_npc_spawn_queue > 0; i++) {
+        g_npc_spawn_queue--;
+        if (create_npc(anthill->gm_x, anthill->gm_y) == NPC_NONE)
+            SDL_Log("Warning: could not create NPC ant\n");
+    }
+    player->ant->prev_x = player->ant->x;
+    player->ant->prev_y = player->ant->y;
+    player->ant->prev_angle = player->ant->angle;
+    move_player(player);
+
+    size_t count = g_npcs.count;
+    grow_outboxes(count);
+#if MAP_STREAMING
+    //paging a tile in changes the map, only one thread may look at it
+    int parts_count = 1;
+#else
+    int parts_count = workers_count();
+    if ((size_t) parts_count > count / SIM_MIN_NPCS_PER_PART) parts_count = count / SIM_MIN_NPCS_PER_PART;
+    if (parts_count < 1) parts_count = 1;
+#endif
+    //ranges start on a multiple of 64 npcs, a cache line of the byte arrays like state (more for the wider ones),
+    //and the arrays are cache line aligned (see npc.c), so that two parts never write to the same line of them
+    size_t part_len = ((count + parts_count - 1) / parts_count + 63) & ~(size_t) 63;
+    SimPart parts[WORKERS_MAX];
+    for (int p = 0; p < parts_count; p++) {
+        size_t begin = p * part_len, end = begin + part_len;
+        parts[p] = (SimPart) {begin < count ? begin : count, end < count ? end : count, 0, 0};
+    }
+    workers_run(run_part, parts, parts_count);
+    resolve_parts(parts, parts_count);
+    if (g_pheromones.levels != NULL && g_sim_ticks % PHEROMONE_UPDATE_TICKS == PHEROMONE_UPDATE_TICKS - 1)
+        update_pheromones();
+    g_sim_ticks++;
+}
+
+void init_anthill(Anthill *anthill) {
+
+    anthill->level = 0;
+    for (int i = 0; i < g_map.height; i++) {
+        for (int j = 0; j < g_map.width; j++) {
+            if (MAP_TILE(j, i) == MAP_ANTHILL) {
+                anthill->gm_x = j + 1;
+                anthill->gm_y = i;
+                anthill->x = (anthill->gm_x - 1) * CELL_SIZE;
+                anthill->y = (anthill->gm_y) * CELL_SIZE;
+                return;
+            }
+        }
+    }
+    SDL_Log("The map does not contain an anthill\n");
+    exit(1);
+}
+
+bool upgrade_anthill(Player *player, Anthill *anthill) {
+    if (anthill->level >= MAX_LEVEL || player->food_count < g_levels_table[anthill->level]) return false;
+    player->food_count -= g_levels_table[anthill->level];
+    queue_npcs(g_levels_table[anthill->level] / 2);
+    anthill->level++;
+    return true;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof word);
+        hash = rng_mix(hash ^ word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, size);
+    return rng_mix(hash ^ tail ^ (uint64_t) size << 56);
+}
+
+uint64_t sim_state_hash(const Player *player, const Anthill *anthill) {
+    const NpcPool *npcs = &g_npcs;
+    uint64_t counters[] = {g_sim_ticks, npcs->count, g_world_food_count, g_npc_spawn_queue,
+        player->food_count, player->in_anthill, anthill->level, g_map.free_count, g_leaf_hash, g_food_rng.state};
+    uint64_t hash = hash_bytes(0, counters, sizeof counters);
+    float player_position[2] = {player->ant->x, player->ant->y};
+    hash = hash_bytes(hash, player_position, sizeof player_position);
+    hash = hash_bytes(hash, &player->ant->angle, sizeof player->ant->angle);
+    hash = hash_bytes(hash, npcs->x, npcs->count * sizeof *npcs->x);
+    hash = hash_bytes(hash, npcs->y, npcs->count * sizeof *npcs->y);
+    hash = hash_bytes(hash, npcs->angle, npcs->count * sizeof *npcs->angle);
+    hash = hash_bytes(hash, npcs->state, npcs->count * sizeof *npcs->state);
+    hash = hash_bytes(hash, npcs->steps_done, npcs->count * sizeof *npcs->steps_done);
+    hash = hash_bytes(hash, npcs->gm_x, npcs->count * sizeof *npcs->gm_x);
+    hash = hash_bytes(hash, npcs->gm_y, npcs->count * sizeof *npcs->gm_y);
+    return hash;
+}
+
+void sim_seed(uint64_t seed) {
+    g_sim_seed = seed;
+    g_npc_seed = rng_stream(seed, SIM_STREAM_NPCS).state;
+    g_food_rng = rng_stream(seed, SIM_STREAM_FOOD);
+    g_looks_rng = rng_stream(seed, SIM_STREAM_LOOKS);
+}
+
+void sim_reset(void) {
+    npc_pool_clear(&g_npcs);
+    g_npc_spawn_queue = 0;
+    g_world_food_count = 0;
+    g_sim_ticks = 0;
+    g_leaf_hash = 0;
+    pickup_queue_drain(&g_pickup_queue, NULL, 0, NULL);
+    sim_seed(g_sim_seed);
+}
@@ -0,0 +1,131 @@
+#ifndef SIM_H
+#define SIM_H 1
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include "map.h"
+#include "npc.h"
+
+//Simulation - the player, npcs, leaves and the anthill. No window or renderer needed.
+
+#define emod(a, b) (((a) % (b)) + (b)) % (b)
+
+extern const Uint32 ANT_MS_TO_MOVE;
+extern const int ANT_VEL_MAX;
+extern const int ANT_TURN_DEGREES;
+extern const int CELL_SIZE;
+extern const int ANT_STEP_LEN;
+extern const int TILES_PER_FOOD;
+extern const int NPC_SPAWNS_PER_TICK;
+extern const int SIM_MIN_NPCS_PER_PART;
+extern const int SIM_MIN_ROWS_PER_PART;
+extern const int NPC_FOLLOW_SCENT_PERCENT;
+
+#define MAX_LEVEL 10
+extern const int g_levels_table[MAX_LEVEL + 1];
+
+//Ant structs hold information needed to draw the player ant
+//Player struct is used to calculate motion. There is a sort of 'inheritance' from Ant
+//(npc ants live in the npc pool, see npc.h)
+
+typedef struct {
+    int8_t frame;
+    Uint32 anim_time;
+    float x;
+    float y;
+    int angle;
+    float prev_x; //before the last tick
+    float prev_y;
+    int prev_angle;
+    float scale;
+} Ant;
+
+typedef struct {
+    Ant *ant;
+    int vel;
+    int turn_vel;
+    int width;
+    int height;
+    int food_count;
+    bool in_anthill;
+} Player;
+
+typedef struct {
+    int x;
+    int y;
+    int gm_x;
+    int gm_y;
+    int level;
+} Anthill;
+
+extern int g_world_food_count;
+//npcs waiting to leave the anthill
+extern int g_npc_spawn_queue;
+//ticks since the last sim_reset
+extern uint64_t g_sim_ticks;
+//seed of the run, set by sim_seed
+extern uint64_t g_sim_seed;
+extern Point g_ant_move_table[8];
+
+//Pickup queue - every leaf picked up by the player or an npc is recorded here and the main loop
+//drains the records once per frame. It is a bounded lock-free ring (SDL atomics, no mutex):
+//any thread may push, one thread drains. If the ring fills up before it is drained
+//the records that don't fit are dropped but still counted.
+#define PICKUP_QUEUE_SIZE 4096 //a power of two
+
+typedef struct {
+    NpcHandle who; //NPC_NONE for the player
+    int gm_x;
+    int gm_y;
+    uint64_t tick; //g_sim_ticks at the pickup
+} Pickup;
+
+typedef struct {
+    Pickup records[PICKUP_QUEUE_SIZE];
+    //positions go round the ring in laps of PICKUP_QUEUE_SIZE, the record of a position can be
+    //written when its sequence is the first position of the lap and drained when it is one more
+    SDL_atomic_t sequence[PICKUP_QUEUE_SIZE];
+    SDL_atomic_t head; //next position to push to
+    SDL_atomic_t dropped;
+    unsigned tail; //next position to drain, only touched by the draining thread
+} PickupQueue;
+
+extern PickupQueue g_pickup_queue;
+
+//false if the ring is full (the pickup is counted as dropped)
+bool pickup_queue_push(PickupQueue *queue, Pickup pickup);
+//move up to max records into out (may be NULL) in the order they were pushed and forget the rest,
+//returns how many pickups there were since the last drain, dropped ones included.
+//*recorded (if not NULL) is set to the number of records put into out
+int pickup_queue_drain(PickupQueue *queue, Pickup *out, int max, int *recorded);
+
+Ant *create_ant(int x, int y);
+NpcHandle create_npc(int gm_x, int gm_y);
+//npcs are created by the simulation a few per tick so that big batches don't stall a frame
+void queue_npcs(int count);
+//coordinates of the entrance (where the ants spawn)
+void init_anthill(Anthill *anthill);
+//spend leaves on the next anthill level, false if there are not enough of them
+bool upgrade_anthill(Player *player, Anthill *anthill);
+
+//place a leaf on a random free tile whose leaf would not be seen in view (world pixels),
+//false if there is no such tile
+bool create_food(SDL_Rect view);
+//create leaves until the map has its share of them
+void seed_food(SDL_Rect view);
+//who is the npc that picked the leaf up or NPC_NONE for the player
+void remove_food(int gm_x, int gm_y, NpcHandle who);
+
+void move_player(Player *player);
+//advance the player and every npc by one step. The npcs are split between the workers
+//(see workers.h) when there are enough of them, the result is the same for any number of threads
+void sim_tick(Player *player, Anthill *anthill);
+//derive the random streams of the simulation (npcs, leaves, looks of the ants) from seed,
+//the same seed and the same inputs give the same run
+void sim_seed(uint64_t seed);
+//hash of everything a tick changes (the player, the npcs, the counters, where leaves were spawned
+//and picked up and the leaf random stream, not the map tiles themselves),
+//two runs that give the same hashes tick after tick behave the same
+uint64_t sim_state_hash(const Player *player, const Anthill *anthill);
+//drop all npcs and leaves before loading another map, the streams start over from g_sim_seed
+void sim_reset(void);
+#endif //SIM_H
@@ -0,0 +1,139 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdbool.h>
+#include "text.h"
+#include "render.h"
+#include "profiler.h"
+#include "batch.h"
+
+#define GLYPH_FIRST ' '
+#define GLYPH_LAST '~'
+#define GLYPHS_NUM (GLYPH_LAST - GLYPH_FIRST + 1)
+#define ATLAS_WIDTH 1024
+
+typedef struct {
+    SDL_Rect rect;   //outlined glyph in the atlas
+    int advance;
+} Glyph;
+
+static SDL_Texture *g_glyph_atlas;
+static Glyph g_glyphs[GLYPHS_NUM];
+static int g_text_height;
+static SpriteBatch g_text_batch;
+#define TEXT_BATCH_INIT_CAPACITY 64
+
+//white glyph blitted onto its black outline
+static SDL_Surface *render_outlined_glyph(TTF_Font *font, Uint16 ch) {
+    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+    SDL_Color black = {0x00, 0x00, 0x00, 0xFF};
+    TTF_SetFontOutline(font, TEXT_OUTLINE_SIZE);
+    SDL_Surface *outline = TTF_RenderGlyph_Blended(font, ch, black);
+    TTF_SetFontOutline(font, 0);
+    SDL_Surface *fg = TTF_RenderGlyph_Blended(font, ch, white);
+    if (outline == NULL || fg == NULL) {
+        SDL_FreeSurface(outline);
+        SDL_FreeSurface(fg);
+        return NULL;
+    }
+    SDL_Rect rect = {TEXT_OUTLINE_SIZE, TEXT_OUTLINE_SIZE, fg->w, fg->h};
+    SDL_SetSurfaceBlendMode(fg, SDL_BLENDMODE_BLEND);
+    SDL_BlitSurface(fg, NULL, outline, &rect);
+    SDL_FreeSurface(fg);
+    return outline;
+}
+
+bool text_init(TTF_Font *font) {
+    SDL_Surface *glyph_surfaces[GLYPHS_NUM] = {0};
+    SDL_Surface *atlas = NULL;
+    bool ok = false;
+    int outline = TTF_GetFontOutline(font);
+    //advances are those of the plain font, the outline only grows the glyphs
+    TTF_SetFontOutline(font, 0);
+
+    //rasterize the glyphs and lay them out on shelves
+    int x = 0, y = 0, shelf_height = 0;
+    for (int i = 0; i < GLYPHS_NUM; i++) {
+        int advance;
+        if (TTF_GlyphMetrics(font, GLYPH_FIRST + i, NULL, NULL, NULL, NULL, &advance) < 0 ||
+            (glyph_surfaces[i] = render_outlined_glyph(font, GLYPH_FIRST + i)) == NULL) {
+            SDL_Log("Error: could not render glyph '%c'! TTF_Error: %s", GLYPH_FIRST + i, TTF_GetError());
+            goto out;
+        }
+        int w = glyph_surfaces[i]->w, h = glyph_surfaces[i]->h;
+        if (x + w > ATLAS_WIDTH) {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+        g_glyphs[i].rect = (SDL_Rect) {x, y, w, h};
+        g_glyphs[i].advance = advance;
+        x += w;
+        if (h > shelf_height) shelf_height = h;
+    }
+    g_text_height = TTF_FontHeight(font) + 2 * TEXT_OUTLINE_SIZE;
+
+    if ((atlas = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, y + shelf_height, 32, SDL_PIXELFORMAT_RGBA32)) == NULL) {
+        SDL_Log("Error: could not create the glyph atlas! SDL_Error: %s", SDL_GetError());
+        goto out;
+    }
+    for (int i = 0; i < GLYPHS_NUM; i++) {
+        //copy the pixels as they are, alpha included
+        SDL_SetSurfaceBlendMode(glyph_surfaces[i], SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(glyph_surfaces[i], NULL, atlas, &g_glyphs[i].rect);
+    }
+    if ((g_glyph_atlas = SDL_CreateTextureFromSurface(g_renderer, atlas)) == NULL) {
+        SDL_Log("Error: could not create the glyph atlas texture! SDL_Error: %s", SDL_GetError());
+        goto out;
+    }
+    SDL_SetTextureBlendMode(g_glyph_atlas, SDL_BLENDMODE_BLEND);
+    Texture atlas_texture = {g_glyph_atlas, atlas->w, atlas->h};
+    ok = batch_init(&g_text_batch, atlas_texture, TEXT_BATCH_INIT_CAPACITY);
+
+out:
+    for (int i = 0; i < GLYPHS_NUM; i++) {
+        SDL_FreeSurface(glyph_surfaces[i]);
+    }
+    SDL_FreeSurface(atlas);
+    TTF_SetFontOutline(font, outline);
+    return ok;
+}
+
+void text_destroy(void) {
+    SDL_DestroyTexture(g_glyph_atlas);
+    g_glyph_atlas = NULL;
+    batch_destroy(&g_text_batch);
+}
+
+static Glyph *glyph(char ch) {
+    if (ch < GLYPH_FIRST || ch > GLYPH_LAST) ch = '?';
+    return &g_glyphs[ch - GLYPH_FIRST];
+}
+
+int text_width(const char *str) {
+    int width = 0;
+    for (; *str; str++) {
+        width += glyph(*str)->advance;
+    }
+    //the outline sticks out of the last glyph
+    return width + 2 * TEXT_OUTLINE_SIZE;
+}
+
+int text_height(void) {
+    return g_text_height;
+}
+
+void render_text(const char *str, int x, int y, float scale) {
+    float pen = x;
+    for (; *str; str++) {
+        Glyph *g = glyph(*str);
+        SDL_FRect render_rect = {
+            pen,
+            y,
+            g->rect.w * scale,
+            g->rect.h * scale
+        };
+        batch_quad(&g_text_batch, &g->rect, render_rect);
+        pen += g->advance * scale;
+    }
+    batch_flush(&g_text_batch);
+}
@@ -0,0 +1,21 @@
+#ifndef TEXT_H
+#define TEXT_H 1
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdbool.h>
+
+//Text - printable ASCII drawn from a glyph atlas.
+//Every glyph is rasterized once (white with a black outline, like load_text_texture does),
+//so drawing a string is one batch of quads (a quad per character) without any allocations.
+
+#define TEXT_OUTLINE_SIZE 2
+
+//build the atlas from the font, needs g_renderer
+bool text_init(TTF_Font *font);
+void text_destroy(void);
+int text_width(const char *str);
+int text_height(void);
+//draw str with its top left corner at x, y
+void render_text(const char *str, int x, int y, float scale);
+
+#endif
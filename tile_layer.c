@@ -0,0 +1,213 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "map.h"
+#include "sim.h"
+#include "render.h"
+#include "tile_layer.h"
+#include "profiler.h"
+#include "batch.h"
+
+typedef struct {
+    SDL_Texture *texture;
+    int chunk;          //chunk held by the texture, -1 if none
+    Uint32 last_used;   //frame the slot was last drawn in
+    int leaves;         //leaves on the chunk when it was rasterized, counted every time it is drawn
+} ChunkSlot;
+
+static ChunkSlot *g_slots;
+static int g_slots_count;
+//slot of every chunk of the map or -1
+static int *g_chunk_slot;
+static int g_chunks_count;
+static Uint32 g_frame;
+static bool g_use_targets;
+static SDL_BlendMode g_premultiplied_blend;
+
+#define WALL_RECTS_NUM 256
+
+static int chunk_pixels(void) {
+    return MAP_CHUNK_SIZE * CELL_SIZE;
+}
+
+static void destroy_slots(void) {
+    for (int i = 0; i < g_slots_count; i++) {
+        SDL_DestroyTexture(g_slots[i].texture);
+    }
+    free(g_slots);
+    g_slots = NULL;
+    g_slots_count = 0;
+}
+
+void tile_layer_destroy(void) {
+    destroy_slots();
+    free(g_chunk_slot);
+    g_chunk_slot = NULL;
+    g_chunks_count = 0;
+}
+
+bool tile_layer_init(void) {
+    tile_layer_destroy();
+    g_chunks_count = MAP_CHUNKS_X(g_map) * MAP_CHUNKS_Y(g_map);
+    if ((g_chunk_slot = malloc(g_chunks_count * sizeof(int))) == NULL) {
+        g_chunks_count = 0;
+        return false;
+    }
+    for (int i = 0; i < g_chunks_count; i++) {
+        g_chunk_slot[i] = -1;
+    }
+    g_premultiplied_blend = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+                                                       SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+    g_use_targets = SDL_RenderTargetSupported(g_renderer);
+    if (!g_use_targets) {
+        SDL_Log("Warning: render targets are not supported, tiles are drawn every frame\n");
+    }
+    return true;
+}
+
+void tile_layer_invalidate(void) {
+    mark_map_chunks_dirty();
+}
+
+//make sure that there are at least count slots
+static bool reserve_slots(int count) {
+    if (count <= g_slots_count) return true;
+    ChunkSlot *slots = realloc(g_slots, count * sizeof(ChunkSlot));
+    if (slots == NULL) return false;
+    g_slots = slots;
+    for (; g_slots_count < count; g_slots_count++) {
+        ChunkSlot *slot = &g_slots[g_slots_count];
+        slot->texture = SDL_CreateTexture(g_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                          chunk_pixels(), chunk_pixels());
+        if (slot->texture == NULL) {
+            SDL_Log("Warning: could not create a chunk texture! SDL_Error: %s\n", SDL_GetError());
+            return false;
+        }
+        //leaves are blended into the cleared texture, so its colours are already multiplied by alpha
+        //and must not be multiplied again when the chunk is drawn
+        if (SDL_SetTextureBlendMode(slot->texture, g_premultiplied_blend) != 0) {
+            SDL_Log("Warning: premultiplied alpha blending is not supported! SDL_Error: %s\n", SDL_GetError());
+            SDL_DestroyTexture(slot->texture);
+            return false;
+        }
+        slot->chunk = -1;
+        slot->last_used = 0;
+        slot->leaves = 0;
+    }
+    return true;
+}
+
+//walls and leaves of the tiles [x0, x1) x [y0, y1), tile (x0, y0) is drawn at (dx, dy),
+//returns the number of leaves drawn
+static int draw_tiles(int x0, int y0, int x1, int y1, int dx, int dy) {
+    SDL_Rect walls[WALL_RECTS_NUM];
+    int walls_count = 0, leaves = 0;
+    SDL_SetRenderDrawColor(g_renderer, 0x00, 0x90, 0x00, 0xFF);
+    for (int i = y0; i < y1; i++) {
+        for (int j = x0; j < x1; j++) {
+            int8_t tile = MAP_TILE(j, i);
+            if (tile == MAP_WALL) {
+                walls[walls_count++] = (SDL_Rect) {
+                    (j - x0) * CELL_SIZE + dx,
+                    (i - y0) * CELL_SIZE + dy,
+                    CELL_SIZE,
+                    CELL_SIZE
+                };
+                if (walls_count == WALL_RECTS_NUM) {
+                    SDL_RenderFillRects(g_renderer, walls, walls_count);
+                    PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+                    walls_count = 0;
+                }
+            }
+            else if (tile == MAP_FOOD) {
+                SDL_FRect render_rect = {
+                    (j - x0) * CELL_SIZE + dx,
+                    (i - y0) * CELL_SIZE + dy,
+                    g_leaf_texture.width,
+                    g_leaf_texture.height
+                };
+                batch_quad(&g_leaf_batch, NULL, render_rect);
+                leaves++;
+            }
+        }
+    }
+    if (walls_count > 0) {
+        SDL_RenderFillRects(g_renderer, walls, walls_count);
+        PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+    }
+    batch_flush(&g_leaf_batch);
+    return leaves;
+}
+
+static void rasterize_chunk(ChunkSlot *slot, int cx, int cy) {
+    SDL_SetRenderTarget(g_renderer, slot->texture);
+    SDL_SetRenderDrawColor(g_renderer, 0x00, 0x00, 0x00, 0x00);
+    SDL_RenderClear(g_renderer);
+    int x0 = cx * MAP_CHUNK_SIZE, y0 = cy * MAP_CHUNK_SIZE;
+    int x1 = SDL_min(x0 + MAP_CHUNK_SIZE, g_map.width), y1 = SDL_min(y0 + MAP_CHUNK_SIZE, g_map.height);
+    slot->leaves = draw_tiles(x0, y0, x1, y1, 0, 0);
+    SDL_SetRenderTarget(g_renderer, NULL);
+}
+
+//least recently used slot that is not on the screen yet
+static int evict_slot(void) {
+    int lru = -1;
+    for (int i = 0; i < g_slots_count; i++) {
+        if (g_slots[i].last_used == g_frame) continue;
+        if (lru == -1 || g_slots[i].last_used < g_slots[lru].last_used) lru = i;
+    }
+    if (g_slots[lru].chunk != -1) {
+        g_chunk_slot[g_slots[lru].chunk] = -1;
+    }
+    return lru;
+}
+
+static void render_tiles_immediate(void) {
+    int x0 = SDL_max(g_camera.x / CELL_SIZE, 0), y0 = SDL_max(g_camera.y / CELL_SIZE, 0);
+    int x1 = SDL_min((g_camera.x + g_camera.w + CELL_SIZE) / CELL_SIZE, g_map.width);
+    int y1 = SDL_min((g_camera.y + g_camera.h + CELL_SIZE) / CELL_SIZE, g_map.height);
+    if (x0 < x1 && y0 < y1) {
+        int leaves = draw_tiles(x0, y0, x1, y1, x0 * CELL_SIZE - g_camera.x, y0 * CELL_SIZE - g_camera.y);
+        PROFILE_COUNT(PROF_LEAVES_DRAWN, leaves);
+        (void) leaves; //without the profiler
+    }
+}
+
+void render_tile_layer(void) {
+    int size = chunk_pixels();
+    //the camera is left of (above) the map when the map is smaller than the screen
+    int cx0 = SDL_max(g_camera.x, 0) / size, cy0 = SDL_max(g_camera.y, 0) / size;
+    int cx1 = SDL_min((g_camera.x + g_camera.w - 1) / size + 1, MAP_CHUNKS_X(g_map));
+    int cy1 = SDL_min((g_camera.y + g_camera.h - 1) / size + 1, MAP_CHUNKS_Y(g_map));
+    if (cx0 >= cx1 || cy0 >= cy1) return;
+
+    //keep twice the screen worth of chunks around to scroll back and forth cheaply
+    if (!g_use_targets || !reserve_slots((cx1 - cx0 + 1) * (cy1 - cy0 + 1) * 2)) {
+        g_use_targets = false;
+        render_tiles_immediate();
+        return;
+    }
+    g_frame++;
+    for (int cy = cy0; cy < cy1; cy++) {
+        for (int cx = cx0; cx < cx1; cx++) {
+            int chunk = cy * MAP_CHUNKS_X(g_map) + cx;
+            int slot = g_chunk_slot[chunk];
+            if (slot == -1) {
+                slot = evict_slot();
+                g_slots[slot].chunk = chunk;
+                g_chunk_slot[chunk] = slot;
+                rasterize_chunk(&g_slots[slot], cx, cy);
+                clear_map_chunk_dirty(cx, cy);
+            }
+            else if (map_chunk_dirty(cx, cy)) {
+                rasterize_chunk(&g_slots[slot], cx, cy);
+                clear_map_chunk_dirty(cx, cy);
+            }
+            g_slots[slot].last_used = g_frame;
+            SDL_Rect render_rect = {cx * size - g_camera.x, cy * size - g_camera.y, size, size};
+            SDL_RenderCopy(g_renderer, g_slots[slot].texture, NULL, &render_rect);
+            PROFILE_COUNT(PROF_DRAW_CALLS, 1);
+            PROFILE_COUNT(PROF_LEAVES_DRAWN, g_slots[slot].leaves);
+        }
+    }
+}
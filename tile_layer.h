@@ -0,0 +1,17 @@
+#ifndef TILE_LAYER_H
+#define TILE_LAYER_H 1
+#include <stdbool.h>
+
+//Tile layer - walls and leaves of g_map pre-rendered in MAP_CHUNK_SIZE x MAP_CHUNK_SIZE tile chunks.
+//Chunks on the screen get a target texture from a LRU cache and are rasterized again only when
+//g_map marks them dirty (set_map_tile), so a frame costs one copy per visible chunk.
+//Without render target support the tiles are drawn one by one every frame.
+
+//call whenever g_map is (re)loaded, needs g_renderer
+bool tile_layer_init(void);
+void tile_layer_destroy(void);
+//the contents of the textures were lost (SDL_RENDER_TARGETS_RESET)
+void tile_layer_invalidate(void);
+void render_tile_layer(void);
+
+#endif
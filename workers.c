@@ -0,0 +1,93 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include "workers.h"
+
+typedef struct {
+    SDL_Thread *thread;
+    SDL_sem *start;
+    int part;
+} Worker;
+
+//g_workers[0] stands for the calling thread and has no thread of its own
+static Worker g_workers[WORKERS_MAX];
+static int g_workers_count = 1;
+static SDL_sem *g_done;
+static SDL_atomic_t g_quit;
+
+//the job being run, written by workers_run before the workers are started
+static WorkerJob g_job;
+static void *g_job_data;
+static int g_job_parts;
+
+static int worker_main(void *data) {
+    Worker *worker = data;
+    for (;;) {
+        SDL_SemWait(worker->start);
+        if (SDL_AtomicGet(&g_quit)) return 0;
+        g_job(g_job_data, worker->part, g_job_parts);
+        SDL_SemPost(g_done);
+    }
+}
+
+bool workers_init(int count) {
+    workers_destroy();
+    if (count <= 0) count = SDL_GetCPUCount();
+    if (count > WORKERS_MAX) count = WORKERS_MAX;
+    if (count <= 1) return true;
+
+    if ((g_done = SDL_CreateSemaphore(0)) == NULL) {
+        SDL_Log("Could not create worker semaphore: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_AtomicSet(&g_quit, 0);
+    for (int i = 1; i < count; i++) {
+        Worker *worker = &g_workers[i];
+        worker->part = i;
+        if ((worker->start = SDL_CreateSemaphore(0)) == NULL ||
+                (worker->thread = SDL_CreateThread(worker_main, "cants-worker", worker)) == NULL) {
+            SDL_Log("Could not start worker thread: %s\n", SDL_GetError());
+            SDL_DestroySemaphore(worker->start);
+            worker->start = NULL;
+            break;
+        }
+        g_workers_count = i + 1;
+    }
+    if (g_workers_count == 1) {
+        workers_destroy();
+        return false;
+    }
+    return true;
+}
+
+void workers_destroy(void) {
+    SDL_AtomicSet(&g_quit, 1);
+    for (int i = 1; i < g_workers_count; i++) {
+        SDL_SemPost(g_workers[i].start);
+        SDL_WaitThread(g_workers[i].thread, NULL);
+        SDL_DestroySemaphore(g_workers[i].start);
+        g_workers[i].thread = NULL;
+        g_workers[i].start = NULL;
+    }
+    g_workers_count = 1;
+    SDL_DestroySemaphore(g_done);
+    g_done = NULL;
+}
+
+int workers_count(void) {
+    return g_workers_count;
+}
+
+void workers_run(WorkerJob job, void *data, int parts) {
+    if (parts > g_workers_count) parts = g_workers_count;
+    if (parts < 1) parts = 1;
+    g_job = job;
+    g_job_data = data;
+    g_job_parts = parts;
+    for (int i = 1; i < parts; i++) {
+        SDL_SemPost(g_workers[i].start);
+    }
+    job(data, 0, parts);
+    for (int i = 1; i < parts; i++) {
+        SDL_SemWait(g_done);
+    }
+}
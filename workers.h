@@ -0,0 +1,23 @@
+#ifndef WORKERS_H
+#define WORKERS_H 1
+#include <stdbool.h>
+
+//Worker pool - a few SDL threads that run one job split into parts at a time.
+//workers_run hands part 0 to the calling thread and the others to the workers and returns
+//once every part is done, so a job may use anything the caller set up before the call
+//and the caller sees everything the parts wrote after it.
+//Without workers_init (or if it fails) every part is run by the caller, one after another.
+
+#define WORKERS_MAX 64
+
+//part is in [0, parts)
+typedef void (*WorkerJob)(void *data, int part, int parts);
+
+//count threads including the caller, <= 0 for one per CPU core
+bool workers_init(int count);
+void workers_destroy(void);
+//threads a job can be split between (at least 1)
+int workers_count(void);
+//parts is clamped to [1, workers_count()]
+void workers_run(WorkerJob job, void *data, int parts);
+#endif //WORKERS_H